@@ -0,0 +1,299 @@
+#include "batch.hpp"
+#include <chrono>
+#include <cstdio>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+using namespace std;
+namespace sudoku {
+
+    namespace {
+
+    const char* const CHECKPOINT_TAG = "sudoku-checkpoint-2";
+
+    struct Checkpoint {
+      unsigned num_shards;   // layout of the run the shard belongs to
+      uint64_t input_size;
+      SearchMode mode;
+      Shard shard;
+      uint64_t next;         // input offset of the next puzzle
+      uint64_t output_size;  // bytes of output covered by stats
+      BatchStats stats;
+    };
+
+    uint64_t file_size(const string& path)
+    {
+      ifstream file(path, ios::binary | ios::ate);
+      if(!file)
+        throw runtime_error("unable to open " + path);
+      return (uint64_t)file.tellg();
+    }
+
+    bool read_checkpoint(const string& path, Checkpoint& ck)
+    {
+      ifstream file(path);
+      if(!file)
+        return false;
+      string tag;
+      int mode = 0;
+      file >> tag >> ck.num_shards >> ck.input_size >> mode
+           >> ck.shard.begin >> ck.shard.end >> ck.next >> ck.output_size
+           >> ck.stats.puzzles >> ck.stats.solved >> ck.stats.invalid
+           >> ck.stats.solve_seconds >> ck.stats.max_seconds;
+      if(!file || tag != CHECKPOINT_TAG)
+        throw runtime_error("corrupt checkpoint " + path);
+      ck.mode = static_cast<SearchMode>(mode);
+      return true;
+    }
+
+    // Write to a temporary file and rename it over the old checkpoint, so a
+    // kill at any point leaves either the old or the new checkpoint intact.
+    void write_checkpoint(const string& path, const Checkpoint& ck)
+    {
+      const string tmp = path + ".tmp";
+      {
+        ofstream file(tmp, ios::trunc);
+        file.precision(17);
+        file << CHECKPOINT_TAG << ' ' << ck.num_shards << ' ' << ck.input_size << ' '
+             << static_cast<int>(ck.mode) << ' ' << ck.shard.begin << ' ' << ck.shard.end << ' '
+             << ck.next << ' ' << ck.output_size << ' '
+             << ck.stats.puzzles << ' ' << ck.stats.solved << ' ' << ck.stats.invalid << ' '
+             << ck.stats.solve_seconds << ' ' << ck.stats.max_seconds << '\n';
+        file.flush();
+        if(!file)
+          throw runtime_error("unable to write " + tmp);
+      }
+      if(rename(tmp.c_str(), path.c_str()) != 0)
+        throw runtime_error("unable to rename " + tmp);
+    }
+
+    // Paths of every <prefix>.<k>.ckpt on disk, whatever the shard count
+    vector<string> checkpoint_paths(const string& prefix)
+    {
+      const size_t slash = prefix.rfind('/');
+      const string dir = slash == string::npos ? "." : prefix.substr(0, slash + 1);
+      const string base = (slash == string::npos ? prefix : prefix.substr(slash + 1)) + ".";
+      const string ext = ".ckpt";
+
+      vector<string> paths;
+      DIR* entries = opendir(dir.c_str());
+      if(!entries)
+        return paths;
+      while(const dirent* entry = readdir(entries))
+      {
+        const string name = entry->d_name;
+        if(name.size() <= base.size() + ext.size() || name.compare(0, base.size(), base) != 0 ||
+           name.compare(name.size() - ext.size(), ext.size(), ext) != 0)
+          continue;
+        const string index = name.substr(base.size(), name.size() - base.size() - ext.size());
+        if(index.find_first_not_of("0123456789") == string::npos)
+          paths.push_back(prefix.substr(0, slash + 1) + name);
+      }
+      closedir(entries);
+      return paths;
+    }
+
+    /* Refuse to mix runs under one prefix: every checkpoint already there
+     * must be for the same shard count, input size and solver, or shards
+     * of the two layouts would overlap in the merged output. */
+    void check_run(const string& prefix, unsigned num_shards, uint64_t input_size, SearchMode mode)
+    {
+      for(const auto& path: checkpoint_paths(prefix))
+      {
+        Checkpoint ck;
+        if(!read_checkpoint(path, ck))
+          continue; // removed since the directory was listed
+        if(ck.num_shards != num_shards || ck.input_size != input_size)
+          throw runtime_error(path + " is for a different input or shard count");
+        if(ck.mode != mode)
+          throw runtime_error(path + " was run with a different search mode");
+      }
+    }
+
+    } // namespace
+
+    BatchStats& BatchStats::operator+=(const BatchStats& other)
+    {
+      puzzles += other.puzzles;
+      solved += other.solved;
+      invalid += other.invalid;
+      solve_seconds += other.solve_seconds;
+      max_seconds = max(max_seconds, other.max_seconds);
+      return *this;
+    }
+
+    /* Cut the file into equal byte ranges, then move each cut forward to the
+     * start of the next line. Shards may be empty when lines are long. */
+    vector<Shard> split_shards(const string& input, unsigned num_shards)
+    {
+      if(num_shards == 0 || num_shards > MAX_SHARDS)
+        throw invalid_argument("shard count must be 1 to " + std::to_string(MAX_SHARDS));
+      const uint64_t size = file_size(input);
+      ifstream file(input, ios::binary);
+
+      vector<uint64_t> cuts = {0};
+      for(unsigned k = 1; k < num_shards; k++)
+      {
+        uint64_t cut = size * k / num_shards;
+        if(cut > 0 && cut > cuts.back())
+        {
+          file.clear();
+          file.seekg(cut - 1);
+          string rest;
+          getline(file, rest);
+          cut = (file && !file.eof()) ? (uint64_t)file.tellg() : size;
+        }
+        cuts.push_back(max(cut, cuts.back()));
+      }
+      cuts.push_back(size);
+
+      vector<Shard> shards;
+      for(unsigned k = 0; k < num_shards; k++)
+        shards.push_back(Shard{cuts[k], cuts[k + 1]});
+      return shards;
+    }
+
+    string shard_path(const string& prefix, unsigned index, const string& ext)
+    {
+      return prefix + "." + std::to_string(index) + "." + ext;
+    }
+
+    BatchStats run_shard(const string& input, const string& prefix,
+                         unsigned index, unsigned num_shards,
+                         SearchMode mode, unsigned long checkpoint_every)
+    {
+      const uint64_t input_size = file_size(input);
+      check_run(prefix, num_shards, input_size, mode);
+      const Shard shard = split_shards(input, num_shards).at(index);
+      const string out_path = shard_path(prefix, index, "out");
+      const string ckpt_path = shard_path(prefix, index, "ckpt");
+
+      Checkpoint ck;
+      if(read_checkpoint(ckpt_path, ck))
+      {
+        if(ck.shard.begin != shard.begin || ck.shard.end != shard.end)
+          throw runtime_error(ckpt_path + " is for a different input or shard count");
+        if(ck.next >= shard.end)
+          return ck.stats; // finished earlier
+        if(file_size(out_path) < ck.output_size)
+          throw runtime_error(out_path + " is shorter than its checkpoint");
+        // drop results written after the checkpoint; they will be redone
+        if(truncate(out_path.c_str(), (off_t)ck.output_size) != 0)
+          throw runtime_error("unable to truncate " + out_path);
+      }
+      else
+      {
+        ck = Checkpoint{num_shards, input_size, mode, shard, shard.begin, 0, BatchStats()};
+        ofstream(out_path, ios::trunc);
+      }
+
+      ifstream in(input, ios::binary);
+      ofstream out(out_path, ios::binary | ios::app);
+      if(!in || !out)
+        throw runtime_error("unable to open " + (!in ? input : out_path));
+      in.seekg(ck.next);
+
+      Sudoku puzzle;
+      puzzle.set_mode(mode);
+      unsigned long pending = 0;
+      string grid;
+      while(ck.next < shard.end && getline(in, grid))
+      {
+        ck.next += grid.size() + (in.eof() ? 0 : 1);
+        if(!grid.empty() && grid.back() == '\r')
+          grid.pop_back();
+
+        ostringstream line;
+        line.precision(6);
+        if(check_puzzle(grid) != GridStatus::OK)
+        {
+          ck.stats.invalid++;
+          line << string(Sudoku::SIZE * Sudoku::SIZE, '.') << " invalid 0\n";
+        }
+        else
+        {
+          auto tic = std::chrono::steady_clock::now();
+          auto ans = puzzle.solve(grid);
+          auto toc = std::chrono::steady_clock::now();
+          std::chrono::duration<double> dt = toc - tic;
+          const auto solution = puzzle.solution();
+          const bool solved = ans && check_solution(grid, solution) == GridStatus::OK;
+
+          ck.stats.solved += solved;
+          ck.stats.solve_seconds += dt.count();
+          ck.stats.max_seconds = max(ck.stats.max_seconds, dt.count());
+          line << solution << (solved ? " solved " : " unsolved ") << fixed << dt.count() << '\n';
+        }
+        ck.stats.puzzles++;
+
+        const string text = line.str();
+        out << text;
+        ck.output_size += text.size();
+        if(++pending == checkpoint_every)
+        {
+          out.flush();
+          if(!out)
+            throw runtime_error("unable to write " + out_path);
+          write_checkpoint(ckpt_path, ck);
+          pending = 0;
+        }
+      }
+
+      out.flush();
+      if(!out)
+        throw runtime_error("unable to write " + out_path);
+      ck.next = shard.end;
+      write_checkpoint(ckpt_path, ck);
+      return ck.stats;
+    }
+
+    /* The checkpoints must tile the input: shard 0 starts at offset 0, each
+     * shard starts where the one before it ended, and the last one ends at
+     * the input size, all from one run with num_shards shards. */
+    BatchStats merge_shards(const string& prefix, unsigned num_shards, const string& output)
+    {
+      vector<Checkpoint> checkpoints(num_shards);
+      for(unsigned k = 0; k < num_shards; k++)
+      {
+        const string ckpt_path = shard_path(prefix, k, "ckpt");
+        Checkpoint& ck = checkpoints[k];
+        if(!read_checkpoint(ckpt_path, ck) || ck.next < ck.shard.end)
+          throw runtime_error("shard " + std::to_string(k) + " is not finished");
+        if(ck.num_shards != num_shards)
+          throw runtime_error(ckpt_path + " is for a run with " +
+                              std::to_string(ck.num_shards) + " shards");
+        const Checkpoint& first = checkpoints[0];
+        if(ck.input_size != first.input_size || ck.mode != first.mode)
+          throw runtime_error(ckpt_path + " is for a different input or search mode");
+        const uint64_t begin = k == 0 ? 0 : checkpoints[k - 1].shard.end;
+        if(ck.shard.begin != begin || ck.shard.end < ck.shard.begin)
+          throw runtime_error(ckpt_path + " does not start where the previous shard ended");
+        if(k == num_shards - 1 && ck.shard.end != ck.input_size)
+          throw runtime_error(ckpt_path + " does not end at the end of the input");
+
+        const string out_path = shard_path(prefix, k, "out");
+        if(file_size(out_path) != ck.output_size)
+          throw runtime_error(out_path + " does not match its checkpoint");
+      }
+
+      BatchStats total;
+      ofstream out(output, ios::binary | ios::trunc);
+      if(!out)
+        throw runtime_error("unable to open " + output);
+      for(unsigned k = 0; k < num_shards; k++)
+      {
+        ifstream in(shard_path(prefix, k, "out"), ios::binary);
+        if(checkpoints[k].output_size > 0)
+          out << in.rdbuf();
+        total += checkpoints[k].stats;
+      }
+      out.flush();
+      if(!out)
+        throw runtime_error("unable to write " + output);
+      return total;
+    }
+
+} // namespace sudoku
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "sudoku.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sudoku {
+
+/* Resumable batch runs over large puzzle files.
+ *
+ * The input is split into num_shards byte ranges that start and end on
+ * line boundaries, so shards can be solved by separate processes (or
+ * threads) with no coordination. Shard k appends one result line per
+ * puzzle to <prefix>.<k>.out:
+ *
+ *     <solution> <solved|unsolved|invalid> <seconds>
+ *
+ * Every checkpoint_every puzzles the output is flushed and <prefix>.<k>.ckpt
+ * is replaced (write then rename) with the shard count, input size and
+ * search mode of the run, the input offset reached, the output size and
+ * the statistics so far. A rerun of a shard truncates its output to the
+ * checkpointed size and carries on from there; a finished shard is not
+ * solved again. A shard will not start while any checkpoint under the
+ * prefix is for another shard count, input size or mode. merge_shards()
+ * checks that the shards cover the input once, in order, then
+ * concatenates their outputs and adds up their statistics. */
+
+// Each run_shard() call splits the whole input, so shard counts stay modest
+constexpr unsigned MAX_SHARDS = 1 << 16;
+
+struct Shard {
+    uint64_t begin;  // byte offset of the first line
+    uint64_t end;    // byte offset just past the last line
+};
+
+struct BatchStats {
+    unsigned long puzzles = 0;
+    unsigned long solved = 0;
+    unsigned long invalid = 0;      // failed check_puzzle()
+    double solve_seconds = 0.0;
+    double max_seconds = 0.0;
+
+    BatchStats& operator+=(const BatchStats& other);
+};
+
+// Throws invalid_argument unless 0 < num_shards <= MAX_SHARDS
+std::vector<Shard> split_shards(const std::string& input, unsigned num_shards);
+
+std::string shard_path(const std::string& prefix, unsigned index, const std::string& ext);
+
+// Solve (or finish solving) one shard; throws runtime_error on I/O errors
+// or when the prefix holds checkpoints of a different run
+BatchStats run_shard(const std::string& input, const std::string& prefix,
+                     unsigned index, unsigned num_shards,
+                     SearchMode mode = SearchMode::NORVIG,
+                     unsigned long checkpoint_every = 1000);
+
+// Combine finished shards into output; throws if a shard is not finished
+// or the shards do not cover the input exactly once
+BatchStats merge_shards(const std::string& prefix, unsigned num_shards,
+                        const std::string& output);
+
+} // namespace sudoku
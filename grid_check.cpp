@@ -0,0 +1,277 @@
+#include "grid_check.hpp"
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+namespace sudoku {
+
+    namespace {
+
+    constexpr int NUM_SQUARES = 81;
+    constexpr int LANES = 8;  // grids per SSE2 register (16 bit lanes)
+
+    // Failure flags gathered while scanning a grid
+    constexpr unsigned F_BAD_CHAR = 1;
+    constexpr unsigned F_BLANK    = 2;
+    constexpr unsigned F_CONFLICT = 4;
+    constexpr unsigned F_MISMATCH = 8;
+
+    inline int row_of(int i) { return i / 9; }
+    inline int col_of(int i) { return i % 9; }
+    inline int box_of(int i) { return (i / 27) * 3 + (i % 9) / 3; }
+
+    inline uint16_t digit_bit(char c)
+    {
+      const unsigned d = (unsigned char)c - '1';
+      return d < 9 ? (uint16_t)(1u << d) : 0;
+    }
+
+    inline bool is_blank(char c) { return c == '.' || c == '0'; }
+
+    /* Scan one grid. Each unit keeps a mask of the digits seen so far, and a
+     * digit already in the mask of any of its square's units is a conflict.
+     * When clues is given, every clue must be kept by grid. */
+    unsigned scan(const char* grid, const char* clues)
+    {
+      uint16_t row[9] = {}, col[9] = {}, box[9] = {};
+      uint16_t conflict = 0, mismatch = 0;
+      bool bad = false, blank = false;
+
+      for(int i = 0; i < NUM_SQUARES; i++)
+      {
+        const char c = grid[i];
+        const uint16_t bit = digit_bit(c);
+        blank |= is_blank(c);
+        bad |= (bit == 0 && !is_blank(c));
+
+        const int r = row_of(i), k = col_of(i), b = box_of(i);
+        conflict |= bit & (row[r] | col[k] | box[b]);
+        row[r] |= bit;
+        col[k] |= bit;
+        box[b] |= bit;
+
+        if(clues)
+        {
+          const uint16_t clue = digit_bit(clues[i]);
+          bad |= (clue == 0 && !is_blank(clues[i]));
+          mismatch |= clue & ~bit;
+        }
+      }
+      return (bad ? F_BAD_CHAR : 0u) | (blank ? F_BLANK : 0u) |
+             (conflict ? F_CONFLICT : 0u) | (mismatch ? F_MISMATCH : 0u);
+    }
+
+    GridStatus puzzle_status(unsigned flags)
+    {
+      if(flags & F_BAD_CHAR)
+        return GridStatus::BAD_CHAR;
+      if(flags & F_CONFLICT)
+        return GridStatus::CONFLICT;
+      return GridStatus::OK;
+    }
+
+    GridStatus solution_status(unsigned flags)
+    {
+      if(flags & F_BAD_CHAR)
+        return GridStatus::BAD_CHAR;
+      if(flags & F_CONFLICT)
+        return GridStatus::CONFLICT;
+      if(flags & F_BLANK)
+        return GridStatus::INCOMPLETE;
+      if(flags & F_MISMATCH)
+        return GridStatus::MISMATCH;
+      return GridStatus::OK;
+    }
+
+#ifdef __SSE2__
+    /* One-hot digit masks for eight characters held in 16 bit lanes;
+     * lanes that are not '1'..'9' come out zero. */
+    inline __m128i digit_bits(__m128i c)
+    {
+      const __m128i d = _mm_sub_epi16(c, _mm_set1_epi16('1'));
+      __m128i bits = _mm_setzero_si128();
+      for(int k = 0; k < 9; k++)
+        bits = _mm_or_si128(bits,
+                 _mm_and_si128(_mm_cmpeq_epi16(d, _mm_set1_epi16(k)),
+                               _mm_set1_epi16(1 << k)));
+      return bits;
+    }
+
+    inline __m128i blanks(__m128i c)
+    {
+      return _mm_or_si128(_mm_cmpeq_epi16(c, _mm_set1_epi16('.')),
+                          _mm_cmpeq_epi16(c, _mm_set1_epi16('0')));
+    }
+
+    // Lanes of v that are non-zero as the low LANES bits of the result
+    inline unsigned lane_mask(__m128i v)
+    {
+      const unsigned zero = _mm_movemask_epi8(_mm_cmpeq_epi16(v, _mm_setzero_si128()));
+      unsigned m = 0;
+      for(int k = 0; k < LANES; k++)
+        if(!(zero & (1u << (2 * k))))
+          m |= 1u << k;
+      return m;
+    }
+
+    /* Scan LANES grids at once, one grid per 16 bit lane. The grids are first
+     * transposed so each load brings in the same square of every grid; the
+     * unit masks are then updated exactly as in scan(). */
+    void scan8(const string* const grids[], const string* const clues[], unsigned flags[])
+    {
+      alignas(16) uint16_t g[NUM_SQUARES][LANES];
+      alignas(16) uint16_t p[NUM_SQUARES][LANES];
+      for(int k = 0; k < LANES; k++)
+      {
+        const char* s = grids[k]->data();
+        for(int i = 0; i < NUM_SQUARES; i++)
+          g[i][k] = (unsigned char)s[i];
+        if(clues)
+        {
+          const char* t = clues[k]->data();
+          for(int i = 0; i < NUM_SQUARES; i++)
+            p[i][k] = (unsigned char)t[i];
+        }
+      }
+
+      __m128i row[9], col[9], box[9];
+      for(int u = 0; u < 9; u++)
+        row[u] = col[u] = box[u] = _mm_setzero_si128();
+      __m128i bad = _mm_setzero_si128(), blank = bad, conflict = bad, mismatch = bad;
+      const __m128i ones = _mm_set1_epi16(-1);
+
+      for(int i = 0; i < NUM_SQUARES; i++)
+      {
+        const __m128i c = _mm_load_si128((const __m128i*)g[i]);
+        const __m128i bit = digit_bits(c);
+        const __m128i is_blank = blanks(c);
+        const __m128i is_digit = _mm_cmpgt_epi16(bit, _mm_setzero_si128());
+        blank = _mm_or_si128(blank, is_blank);
+        bad = _mm_or_si128(bad, _mm_andnot_si128(_mm_or_si128(is_digit, is_blank), ones));
+
+        const int r = row_of(i), k = col_of(i), b = box_of(i);
+        const __m128i seen = _mm_or_si128(row[r], _mm_or_si128(col[k], box[b]));
+        conflict = _mm_or_si128(conflict, _mm_and_si128(bit, seen));
+        row[r] = _mm_or_si128(row[r], bit);
+        col[k] = _mm_or_si128(col[k], bit);
+        box[b] = _mm_or_si128(box[b], bit);
+
+        if(clues)
+        {
+          const __m128i pc = _mm_load_si128((const __m128i*)p[i]);
+          const __m128i clue = digit_bits(pc);
+          const __m128i clue_ok = _mm_or_si128(_mm_cmpgt_epi16(clue, _mm_setzero_si128()),
+                                               blanks(pc));
+          bad = _mm_or_si128(bad, _mm_andnot_si128(clue_ok, ones));
+          mismatch = _mm_or_si128(mismatch, _mm_andnot_si128(bit, clue));
+        }
+      }
+
+      const unsigned m_bad = lane_mask(bad), m_blank = lane_mask(blank);
+      const unsigned m_conflict = lane_mask(conflict), m_mismatch = lane_mask(mismatch);
+      for(int k = 0; k < LANES; k++)
+      {
+        const unsigned lane = 1u << k;
+        flags[k] = ((m_bad & lane) ? F_BAD_CHAR : 0u) | ((m_blank & lane) ? F_BLANK : 0u) |
+                   ((m_conflict & lane) ? F_CONFLICT : 0u) |
+                   ((m_mismatch & lane) ? F_MISMATCH : 0u);
+      }
+    }
+#endif
+
+    /* Check every pair (clues[i], grids[i]) and map the scan flags to a
+     * status. Grids of the wrong length are reported without scanning; the
+     * rest are queued and scanned LANES at a time. */
+    vector<GridStatus> check_all(const vector<string>& grids, const vector<string>* clues,
+                                 GridStatus (*status_of)(unsigned))
+    {
+      vector<GridStatus> status(grids.size(), GridStatus::OK);
+      vector<size_t> todo;
+      todo.reserve(grids.size());
+      for(size_t i = 0; i < grids.size(); i++)
+        if(grids[i].size() != NUM_SQUARES ||
+           (clues && (*clues)[i].size() != NUM_SQUARES))
+          status[i] = GridStatus::BAD_LENGTH;
+        else
+          todo.push_back(i);
+
+      size_t n = 0;
+#ifdef __SSE2__
+      for(; n + LANES <= todo.size(); n += LANES)
+      {
+        const string* g[LANES];
+        const string* p[LANES];
+        unsigned flags[LANES];
+        for(int k = 0; k < LANES; k++)
+        {
+          g[k] = &grids[todo[n + k]];
+          p[k] = clues ? &(*clues)[todo[n + k]] : nullptr;
+        }
+        scan8(g, clues ? p : nullptr, flags);
+        for(int k = 0; k < LANES; k++)
+          status[todo[n + k]] = status_of(flags[k]);
+      }
+#endif
+      for(; n < todo.size(); n++)
+      {
+        const size_t i = todo[n];
+        status[i] = status_of(scan(grids[i].data(), clues ? (*clues)[i].data() : nullptr));
+      }
+      return status;
+    }
+
+    } // namespace
+
+    const char* to_string(GridStatus status)
+    {
+      switch(status)
+      {
+        case GridStatus::OK:         return "ok";
+        case GridStatus::BAD_LENGTH: return "bad length";
+        case GridStatus::BAD_CHAR:   return "bad character";
+        case GridStatus::CONFLICT:   return "conflict";
+        case GridStatus::INCOMPLETE: return "incomplete";
+        case GridStatus::MISMATCH:   return "mismatch";
+      }
+      return "unknown";
+    }
+
+    GridStatus check_puzzle(const string& grid)
+    {
+      if(grid.size() != NUM_SQUARES)
+        return GridStatus::BAD_LENGTH;
+      return puzzle_status(scan(grid.data(), nullptr));
+    }
+
+    GridStatus check_solution(const string& solution)
+    {
+      if(solution.size() != NUM_SQUARES)
+        return GridStatus::BAD_LENGTH;
+      return solution_status(scan(solution.data(), nullptr));
+    }
+
+    GridStatus check_solution(const string& puzzle, const string& solution)
+    {
+      if(puzzle.size() != NUM_SQUARES || solution.size() != NUM_SQUARES)
+        return GridStatus::BAD_LENGTH;
+      return solution_status(scan(solution.data(), puzzle.data()));
+    }
+
+    vector<GridStatus> check_puzzles(const vector<string>& grids)
+    {
+      return check_all(grids, nullptr, puzzle_status);
+    }
+
+    vector<GridStatus> check_solutions(const vector<string>& puzzles,
+                                       const vector<string>& solutions)
+    {
+      if(puzzles.size() != solutions.size())
+        throw invalid_argument("check_solutions: puzzles and solutions differ in number");
+      return check_all(solutions, &puzzles, solution_status);
+    }
+
+} // namespace sudoku
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace sudoku {
+
+/* Result of checking a raw 81 character grid. Checks stop at the first
+ * failure in the order listed here. */
+enum class GridStatus {
+    OK,
+    BAD_LENGTH,  // not exactly 81 characters
+    BAD_CHAR,    // a character other than 1-9, '0' or '.'
+    CONFLICT,    // a digit is repeated in a row, column or box
+    INCOMPLETE,  // solution still has an empty square
+    MISMATCH     // solution disagrees with a clue of the puzzle
+};
+
+const char* to_string(GridStatus status);
+
+// A puzzle is valid when it has only legal characters and no repeated clues.
+GridStatus check_puzzle(const std::string& grid);
+
+// A solution is valid when it is complete, has no repeats and keeps every
+// clue of the puzzle it was solved from.
+GridStatus check_solution(const std::string& solution);
+GridStatus check_solution(const std::string& puzzle, const std::string& solution);
+
+/* Batch versions; status[i] is the result for grids[i]. Grids are checked
+ * eight at a time in 16 bit SSE2 lanes (one lane per grid) when the target
+ * supports it, and one at a time otherwise. check_solutions() throws
+ * invalid_argument when puzzles and solutions differ in number. */
+std::vector<GridStatus> check_puzzles(const std::vector<std::string>& grids);
+std::vector<GridStatus> check_solutions(const std::vector<std::string>& puzzles,
+                                        const std::vector<std::string>& solutions);
+
+} // namespace sudoku
@@ -0,0 +1,472 @@
+#include "learning.hpp"
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+namespace sudoku {
+
+    namespace {
+
+    constexpr int NUM_SQUARES = 81;
+    constexpr int NUM_UNITS = 27;
+    constexpr int NUM_VARS = NUM_SQUARES * 9;
+
+    inline int var_of(int square, int digit) { return square * 9 + digit; }
+    inline int pos(int var) { return 2 * var; }
+    inline int neg(int var) { return 2 * var + 1; }
+    inline int var_of(int lit) { return lit >> 1; }
+    inline bool is_neg(int lit) { return lit & 1; }
+
+    /* Squares of each unit (columns, rows, boxes as in make_unit_list),
+     * units of each square, and the 20 peers of each square. */
+    struct Geometry {
+      int unit_squares[NUM_UNITS][9];
+      int square_units[NUM_SQUARES][3];
+      int peers[NUM_SQUARES][20];
+
+      Geometry()
+      {
+        for(int i = 0; i < 9; i++)
+          for(int k = 0; k < 9; k++)
+          {
+            unit_squares[i][k] = k * 9 + i;
+            unit_squares[9 + i][k] = i * 9 + k;
+            unit_squares[18 + i][k] = ((i / 3) * 3 + k / 3) * 9 + (i % 3) * 3 + k % 3;
+          }
+        for(int s = 0; s < NUM_SQUARES; s++)
+        {
+          const int r = s / 9, c = s % 9;
+          square_units[s][0] = c;
+          square_units[s][1] = 9 + r;
+          square_units[s][2] = 18 + (r / 3) * 3 + c / 3;
+          int n = 0;
+          for(int t = 0; t < NUM_SQUARES; t++)
+            if(t != s && (t / 9 == r || t % 9 == c ||
+                          ((t / 27) == (s / 27) && (t % 9) / 3 == c / 3)))
+              peers[s][n++] = t;
+          assert(n == 20);
+        }
+      }
+    };
+
+    const Geometry& geometry()
+    {
+      static const Geometry g;
+      return g;
+    }
+
+    } // namespace
+
+    LearningSearch::LearningSearch(size_t max_nogoods)
+      : max_nogoods(max_nogoods)
+    {
+    }
+
+    void LearningSearch::reset()
+    {
+      value.assign(NUM_VARS, -1);
+      level.assign(NUM_VARS, 0);
+      reason.assign(NUM_VARS, Reason{NONE, 0});
+      square_count.assign(NUM_SQUARES, 9);
+      place_count.assign(NUM_UNITS * 9, 9);
+      trail.clear();
+      trail_lim.clear();
+      queue_head = 0;
+      nogoods.clear();
+      free_nogoods.clear();
+      watches.assign(2 * NUM_VARS, vector<int>());
+      live_nogoods = 0;
+      seen.assign(NUM_VARS, 0);
+    }
+
+    int LearningSearch::lit_value(int lit) const
+    {
+      const int v = value[var_of(lit)];
+      if(v < 0)
+        return -1;
+      return is_neg(lit) ? 1 - v : v;
+    }
+
+    /* Literals of the constraint that forces lit, including lit itself.
+     * All of them except lit are false when it is forced. */
+    void LearningSearch::reason_lits(int lit, Reason why, vector<int>& lits) const
+    {
+      lits.clear();
+      switch(why.kind)
+      {
+        case PEER:
+          lits.push_back(lit);
+          lits.push_back(why.index ^ 1);
+          break;
+        case SQUARE:
+          for(int d = 0; d < 9; d++)
+            lits.push_back(pos(var_of(why.index, d)));
+          break;
+        case UNIT:
+          for(const auto s: geometry().unit_squares[why.index / 9])
+            lits.push_back(pos(var_of(s, why.index % 9)));
+          break;
+        case NOGOOD:
+          lits = nogoods[why.index].lits;
+          break;
+        case NONE:
+          lits.push_back(lit);
+          break;
+      }
+    }
+
+    bool LearningSearch::enqueue(int lit, Reason why)
+    {
+      const int v = var_of(lit);
+      const int current = lit_value(lit);
+      if(current == 1)
+        return true;
+      if(current == 0)
+      {
+        reason_lits(lit, why, conflict);
+        return false; // contradiction; the constraint that forces lit is violated
+      }
+
+      value[v] = is_neg(lit) ? 0 : 1;
+      level[v] = decision_level();
+      reason[v] = why;
+      trail.push_back(lit);
+      if(is_neg(lit))
+      {
+        const int s = v / 9, d = v % 9;
+        square_count[s]--;
+        for(const auto u: geometry().square_units[s])
+          place_count[u * 9 + d]--;
+      }
+      if(why.kind != NONE)
+        counters.propagations++;
+      return true;
+    }
+
+    // A placed digit eliminates the square's other digits and itself from the peers
+    bool LearningSearch::propagate_true(int lit)
+    {
+      const int v = var_of(lit), s = v / 9, d = v % 9;
+      for(int e = 0; e < 9; e++)
+        if(e != d && !enqueue(neg(var_of(s, e)), Reason{PEER, lit}))
+          return false;
+      for(const auto p: geometry().peers[s])
+        if(!enqueue(neg(var_of(p, d)), Reason{PEER, lit}))
+          return false;
+      return true;
+    }
+
+    // An eliminated digit may leave its square, or one of its units, one place
+    bool LearningSearch::propagate_false(int lit)
+    {
+      const Geometry& g = geometry();
+      const int v = var_of(lit), s = v / 9, d = v % 9;
+
+      if(square_count[s] == 0)
+      {
+        conflict.clear();
+        for(int e = 0; e < 9; e++)
+          conflict.push_back(pos(var_of(s, e)));
+        return false; // contradiction; eliminated last possibility
+      }
+      if(square_count[s] == 1)
+        for(int e = 0; e < 9; e++)
+          if(value[var_of(s, e)] != 0 &&
+             !enqueue(pos(var_of(s, e)), Reason{SQUARE, s}))
+            return false;
+
+      for(const auto u: g.square_units[s])
+      {
+        const int k = u * 9 + d;
+        if(place_count[k] == 0)
+        {
+          conflict.clear();
+          for(const auto t: g.unit_squares[u])
+            conflict.push_back(pos(var_of(t, d)));
+          return false; // contradiction; no place for this value
+        }
+        if(place_count[k] == 1)
+          for(const auto t: g.unit_squares[u])
+            if(value[var_of(t, d)] != 0 &&
+               !enqueue(pos(var_of(t, d)), Reason{UNIT, k}))
+              return false;
+      }
+      return true;
+    }
+
+    // Visit the nogoods watching false_lit, which has just become false
+    bool LearningSearch::propagate_nogoods(int false_lit)
+    {
+      vector<int>& ws = watches[false_lit];
+      size_t i = 0, j = 0;
+      bool ok = true;
+      while(i < ws.size())
+      {
+        const int index = ws[i++];
+        vector<int>& lits = nogoods[index].lits;
+        if(lits[0] == false_lit)
+          swap(lits[0], lits[1]);
+        if(lit_value(lits[0]) == 1)
+        {
+          ws[j++] = index;
+          continue;
+        }
+
+        size_t k = 2;
+        while(k < lits.size() && lit_value(lits[k]) == 0)
+          k++;
+        if(k < lits.size())
+        {
+          swap(lits[1], lits[k]);
+          watches[lits[1]].push_back(index);
+          continue;
+        }
+
+        ws[j++] = index;
+        if(lit_value(lits[0]) == 0)
+        {
+          conflict = lits;
+          counters.nogood_conflicts++;
+          ok = false;
+          break;
+        }
+        enqueue(lits[0], Reason{NOGOOD, index});
+        counters.nogood_propagations++;
+      }
+      while(i < ws.size())
+        ws[j++] = ws[i++];
+      ws.resize(j);
+      return ok;
+    }
+
+    bool LearningSearch::propagate()
+    {
+      while(queue_head < trail.size())
+      {
+        const int lit = trail[queue_head++];
+        if(!(is_neg(lit) ? propagate_false(lit) : propagate_true(lit)))
+          return false;
+        if(!propagate_nogoods(lit ^ 1))
+          return false;
+      }
+      return true;
+    }
+
+    /* Expand reasons from the conflict back along the trail until a single
+     * literal of the current level remains (the first unique implication
+     * point). Literals of earlier levels go into the nogood as they are
+     * met; level 0 literals follow from the clues and are left out. */
+    void LearningSearch::analyze(vector<int>& learnt, int& backjump_level)
+    {
+      vector<int> lits = conflict;
+      learnt.assign(1, -1);
+      int pending = 0;
+      int p = -1;
+      size_t index = trail.size();
+
+      for(;;)
+      {
+        counters.explanations++;
+        for(const auto q: lits)
+        {
+          const int v = var_of(q);
+          if(p >= 0 && v == var_of(p))
+            continue;
+          if(!seen[v] && level[v] > 0)
+          {
+            seen[v] = 1;
+            if(level[v] == decision_level())
+              pending++;
+            else
+              learnt.push_back(q);
+          }
+        }
+        do
+          index--;
+        while(!seen[var_of(trail[index])]);
+        p = trail[index];
+        seen[var_of(p)] = 0;
+        if(--pending == 0)
+          break;
+
+        const Reason& why = reason[var_of(p)];
+        if(why.kind == NOGOOD)
+          nogoods[why.index].activity++;
+        reason_lits(p, why, lits);
+      }
+      learnt[0] = p ^ 1;
+
+      backjump_level = 0;
+      for(size_t k = 1; k < learnt.size(); k++)
+      {
+        seen[var_of(learnt[k])] = 0;
+        if(level[var_of(learnt[k])] > backjump_level)
+        {
+          backjump_level = level[var_of(learnt[k])];
+          swap(learnt[1], learnt[k]);
+        }
+      }
+    }
+
+    void LearningSearch::backtrack(int target_level)
+    {
+      const size_t target = trail_lim[target_level];
+      while(trail.size() > target)
+      {
+        const int lit = trail.back();
+        const int v = var_of(lit);
+        trail.pop_back();
+        if(is_neg(lit))
+        {
+          const int s = v / 9, d = v % 9;
+          square_count[s]++;
+          for(const auto u: geometry().square_units[s])
+            place_count[u * 9 + d]++;
+        }
+        value[v] = -1;
+      }
+      trail_lim.resize(target_level);
+      queue_head = trail.size();
+    }
+
+    // Store the nogood and assert its first literal, which it now forces
+    void LearningSearch::learn(const vector<int>& learnt)
+    {
+      counters.nogoods_learned++;
+      counters.nogood_literals += learnt.size();
+      if(learnt.size() == 1)
+      {
+        enqueue(learnt[0], Reason{NONE, 0});
+        return;
+      }
+
+      int index;
+      if(!free_nogoods.empty())
+      {
+        index = free_nogoods.back();
+        free_nogoods.pop_back();
+      }
+      else
+      {
+        index = (int)nogoods.size();
+        nogoods.push_back(Nogood());
+      }
+      nogoods[index].lits = learnt;
+      nogoods[index].activity = 1;
+      nogoods[index].deleted = false;
+      watches[learnt[0]].push_back(index);
+      watches[learnt[1]].push_back(index);
+      live_nogoods++;
+      enqueue(learnt[0], Reason{NOGOOD, index});
+    }
+
+    void LearningSearch::delete_nogood(int index)
+    {
+      Nogood& ng = nogoods[index];
+      for(int w = 0; w < 2; w++)
+      {
+        vector<int>& ws = watches[ng.lits[w]];
+        ws.erase(find(ws.begin(), ws.end(), index));
+      }
+      ng.lits.clear();
+      ng.deleted = true;
+      free_nogoods.push_back(index);
+      live_nogoods--;
+      counters.nogoods_deleted++;
+    }
+
+    /* Keep the store bounded: drop the half of the nogoods that took part
+     * in the fewest conflicts, longest first among equals. Nogoods that are
+     * the reason for a current assignment stay. */
+    void LearningSearch::reduce_nogoods()
+    {
+      vector<int> candidates;
+      for(int i = 0; i < (int)nogoods.size(); i++)
+      {
+        const Nogood& ng = nogoods[i];
+        if(ng.deleted)
+          continue;
+        const int v = var_of(ng.lits[0]);
+        if(lit_value(ng.lits[0]) == 1 && reason[v].kind == NOGOOD && reason[v].index == i)
+          continue; // locked
+        candidates.push_back(i);
+      }
+      sort(candidates.begin(), candidates.end(), [this](int a, int b) {
+        if(nogoods[a].activity != nogoods[b].activity)
+          return nogoods[a].activity < nogoods[b].activity;
+        return nogoods[a].lits.size() > nogoods[b].lits.size();
+      });
+      for(size_t k = 0; k < candidates.size() / 2; k++)
+        delete_nogood(candidates[k]);
+    }
+
+    // Place the first open digit of the square with the fewest candidates
+    int LearningSearch::pick_decision() const
+    {
+      int min_s = -1;
+      for(int s = 0; s < NUM_SQUARES; s++)
+        if(square_count[s] > 1 && (min_s < 0 || square_count[s] < square_count[min_s]))
+          min_s = s;
+      if(min_s < 0)
+        return -1; // solved!
+      for(int d = 0; d < 9; d++)
+        if(value[var_of(min_s, d)] < 0)
+          return pos(var_of(min_s, d));
+      return -1;
+    }
+
+    bool LearningSearch::solve(const string& grid, string& solution)
+    {
+      assert(grid.size() == NUM_SQUARES);
+      reset();
+
+      bool ok = true;
+      for(int s = 0; s < NUM_SQUARES && ok; s++)
+      {
+        const unsigned d = (unsigned char)grid[s] - '1';
+        if(d < 9)
+          ok = enqueue(pos(var_of(s, d)), Reason{NONE, 0});
+      }
+
+      vector<int> learnt;
+      while(ok)
+      {
+        if(!propagate())
+        {
+          counters.conflicts++;
+          if(decision_level() == 0)
+          {
+            ok = false;
+            break;
+          }
+          int backjump_level;
+          analyze(learnt, backjump_level);
+          if(decision_level() - backjump_level > 1)
+          {
+            counters.backjumps++;
+            counters.levels_skipped += decision_level() - backjump_level - 1;
+          }
+          backtrack(backjump_level);
+          learn(learnt);
+          if(live_nogoods > max_nogoods)
+            reduce_nogoods();
+          continue;
+        }
+
+        const int lit = pick_decision();
+        if(lit < 0)
+          break;
+        counters.decisions++;
+        trail_lim.push_back(trail.size());
+        enqueue(lit, Reason{NONE, 0});
+      }
+
+      solution.assign(NUM_SQUARES, '.');
+      for(int s = 0; s < NUM_SQUARES; s++)
+        for(int d = 0; d < 9; d++)
+          if(value[var_of(s, d)] == 1)
+            solution[s] = '1' + d;
+      return ok;
+    }
+
+} // namespace sudoku
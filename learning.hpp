@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sudoku {
+
+/* Counters for the learning search, grouped by feature. They accumulate
+ * over every puzzle solved by one LearningSearch. */
+struct LearningStats {
+    // search
+    unsigned long decisions = 0;
+    unsigned long propagations = 0;     // literals assigned with a reason
+    unsigned long conflicts = 0;
+    // reasons and explanations
+    unsigned long explanations = 0;     // reasons expanded by conflict analysis
+    // nogood store
+    unsigned long nogoods_learned = 0;
+    unsigned long nogood_literals = 0;  // total size of the learned nogoods
+    unsigned long nogoods_deleted = 0;
+    unsigned long nogood_propagations = 0;
+    unsigned long nogood_conflicts = 0;
+    // backjumping
+    unsigned long backjumps = 0;        // jumps back over more than one level
+    unsigned long levels_skipped = 0;   // levels a chronological backtrack would revisit
+};
+
+/* Search with conflict-driven nogood learning and backjumping.
+ *
+ * A variable is a (square, digit) candidate; its positive literal places
+ * the digit and its negative literal eliminates it. Every assignment keeps
+ * the reason it was made: a decision, a placed digit eliminating its peers,
+ * a square or unit left with one place, or a learned nogood. On a conflict
+ * the reasons are expanded back to the first unique implication point of
+ * the current decision level. The resulting nogood says which earlier
+ * decisions are to blame, so search jumps straight back to the deepest of
+ * them instead of retrying every level in between. Learned nogoods are
+ * kept, up to max_nogoods, to prune later branches. */
+class LearningSearch {
+public:
+    explicit LearningSearch(size_t max_nogoods = 10000);
+
+    // grid must pass check_puzzle(); solution gets '.' for unsolved squares
+    bool solve(const std::string& grid, std::string& solution);
+    const LearningStats& stats() const { return counters; }
+
+private:
+    enum ReasonKind : uint8_t { NONE, PEER, SQUARE, UNIT, NOGOOD };
+    struct Reason {
+        ReasonKind kind;
+        int index;  // PEER: the true literal; SQUARE: square; UNIT: unit*9+digit; NOGOOD: clause
+    };
+    struct Nogood {
+        std::vector<int> lits;  // lits[0] and lits[1] are watched
+        unsigned long activity;
+        bool deleted;
+    };
+
+    size_t max_nogoods;
+    LearningStats counters;
+
+    std::vector<int8_t> value;          // per variable: -1 unassigned, 0 false, 1 true
+    std::vector<int> level;             // per variable
+    std::vector<Reason> reason;         // per variable
+    std::vector<uint8_t> square_count;  // candidates left per square
+    std::vector<uint8_t> place_count;   // places left per unit and digit
+    std::vector<int> trail;             // true literals in assignment order
+    std::vector<size_t> trail_lim;      // trail size at the start of each level
+    size_t queue_head = 0;
+
+    std::vector<Nogood> nogoods;
+    std::vector<int> free_nogoods;
+    std::vector<std::vector<int>> watches;  // per literal: nogoods watching it
+    size_t live_nogoods = 0;
+
+    std::vector<int> conflict;          // literals of the violated constraint
+    std::vector<uint8_t> seen;
+
+    void reset();
+    int decision_level() const { return (int)trail_lim.size(); }
+    int lit_value(int lit) const;
+    bool enqueue(int lit, Reason why);
+    void reason_lits(int lit, Reason why, std::vector<int>& lits) const;
+    bool propagate();
+    bool propagate_true(int lit);
+    bool propagate_false(int lit);
+    bool propagate_nogoods(int false_lit);
+    void analyze(std::vector<int>& learnt, int& backjump_level);
+    void backtrack(int target_level);
+    void learn(const std::vector<int>& learnt);
+    void delete_nogood(int index);
+    void reduce_nogoods();
+    int pick_decision() const;
+};
+
+} // namespace sudoku
@@ -1,9 +1,13 @@
 
 #include "threadsafe_stack.hpp"
 #include "sudoku.hpp"
+#include "batch.hpp"
+#include "variants.hpp"
 #include <chrono>
+#include <climits>
 #include <iostream>
 #include <iomanip>
+#include <stdexcept>
 
 using namespace threadsafe_stack;
 using namespace sudoku;
@@ -47,6 +51,21 @@ vector<string> from_file(string filename)
     return grids;
 }
 
+vector<string> lines_from_file(string filename)
+{
+    vector<string> lines;
+    string line;
+    ifstream file(filename);
+    if (file.is_open())
+    {
+      while (getline(file, line))
+        lines.push_back(line);
+      file.close();
+    }
+    else cout << "Unable to open file";
+    return lines;
+}
+
 /* Thread needs:
 *   Input:
 *     1. puzzle list
@@ -83,7 +102,7 @@ void solve_some(const vector<string>& grids,
         accum_time += dt;
         max_time = std::max(max_time, dt);
 
-        if(ans && puzzle.is_solved())
+        if(ans && check_solution(grid, puzzle.solution()) == GridStatus::OK)
 	    solved_count++;
     }
 
@@ -101,11 +120,10 @@ void join_all(std::vector<std::thread>& v)
     std::for_each(v.begin(), v.end(), do_join);
 }
 
-unsigned int get_num_threads(unsigned int num_items)
+unsigned int get_num_threads(unsigned int num_items, unsigned int min_per_thread = 25)
 {
     unsigned int const hw_threads = std::thread::hardware_concurrency();
 
-    unsigned int min_per_thread = 25;
     auto max_threads = (num_items + min_per_thread - 1) / min_per_thread;
     auto num_threads =
             std::min(hw_threads != 0 ? hw_threads : 2, max_threads);
@@ -156,9 +174,10 @@ void solve_all_mt(const vector<string>& grids,
 
 void solve_all(const vector<string> grids,
         const string filename, const bool print_all=false,
-        const double display_if=1.0)
+        const double display_if=1.0, const SearchMode mode=SearchMode::NORVIG)
 {
     Sudoku puzzle;
+    puzzle.set_mode(mode);
     unsigned solved_count = 0;
     std::chrono::duration<double> total_time(0.0);
     std::chrono::duration<double> max_time(0.0);
@@ -178,7 +197,7 @@ void solve_all(const vector<string> grids,
       if(print_all)
       {
         string result = " incorrectly solved in ";
-        if(ans && puzzle.is_solved())
+        if(ans && check_solution(grid, puzzle.solution()) == GridStatus::OK)
           result = " correctly solved in ";
         std::cout << "Puzzle " << setw(2) << i+1 << result << setw(9)
                   << steps << " steps, " << fixed << setprecision(3) << setw(6)
@@ -191,7 +210,7 @@ void solve_all(const vector<string> grids,
         display(grid);
         puzzle.display();
       }
-      if(ans && puzzle.is_solved())
+      if(ans && check_solution(grid, puzzle.solution()) == GridStatus::OK)
 	solved_count++;
     }
     auto n = grids.size();
@@ -202,10 +221,259 @@ void solve_all(const vector<string> grids,
               << " sec (" << fixed << setprecision(3) << 1.0/avg_duration
               << " Hz), max: " << fixed << setprecision(3) << (double)max_time.count()
               << " sec]" << std::endl;
+    if(mode == SearchMode::LEARNING)
+    {
+      const auto& stats = puzzle.get_learning_stats();
+      std::cout << "  search: " << stats.decisions << " decisions, "
+                << stats.propagations << " propagations, " << stats.conflicts << " conflicts\n"
+                << "  explanations: " << stats.explanations << " reasons expanded\n"
+                << "  nogoods: " << stats.nogoods_learned << " learned ("
+                << stats.nogood_literals << " literals), " << stats.nogoods_deleted << " deleted, "
+                << stats.nogood_propagations << " propagations, "
+                << stats.nogood_conflicts << " conflicts\n"
+                << "  backjumping: " << stats.backjumps << " backjumps, "
+                << stats.levels_skipped << " levels skipped" << std::endl;
+    }
+}
+
+/* Variant puzzles are one grid per line; killer lines also carry cages */
+template<class Rules>
+bool parse_variant(const string& line, string& grid, Variant<Rules>& variant)
+{
+    grid = line.substr(0, Sudoku::SIZE * Sudoku::SIZE);
+    variant = Variant<Rules>();
+    return check_puzzle(grid) == GridStatus::OK;
+}
+
+template<>
+bool parse_variant(const string& line, string& grid, Variant<Killer>& variant)
+{
+    vector<Cage> cages;
+    if(!parse_killer(line, grid, cages) || check_puzzle(grid) != GridStatus::OK)
+        return false;
+    variant = Variant<Killer>(cages);
+    return true;
+}
+
+template<class Rules>
+void solve_all_variant(const vector<string> lines, const string filename)
+{
+    unsigned solved_count = 0;
+    std::chrono::duration<double> total_time(0.0);
+    std::chrono::duration<double> max_time(0.0);
+
+    for(const auto& line: lines)
+    {
+      string grid;
+      Variant<Rules> variant;
+      if(!parse_variant(line, grid, variant))
+        continue;
+      Board board = make_board(grid);
+      unsigned long nodes = 0;
+      auto tic = std::chrono::steady_clock::now();
+      auto ans = variant.search(board, nodes);
+      auto toc = std::chrono::steady_clock::now();
+      std::chrono::duration<double> dt = toc - tic;
+      total_time += dt;
+      max_time = std::max(max_time, dt);
+      if(ans && variant.check(grid, board_grid(board)))
+        solved_count++;
+    }
+    auto n = lines.size();
+    double avg_duration = (double)total_time.count() / (double)n;
+    std::cout << "Solved " << solved_count << " of " << n << " " << filename
+              << " puzzles in " << fixed << setprecision(3) << (double)total_time.count()
+              << " seconds [avg: " << setprecision(4) << avg_duration
+              << " sec (" << fixed << setprecision(3) << 1.0/avg_duration
+              << " Hz), max: " << fixed << setprecision(3) << (double)max_time.count()
+              << " sec]" << std::endl;
+}
+
+/* Parse a numeric argument: digits only (stoul would wrap a leading '-')
+ * and at most limit. Numbers too big for unsigned long throw out_of_range
+ * from stoul. */
+bool parse_unsigned(const string& text, unsigned long limit, unsigned& value)
+{
+    if(text.empty() || text.find_first_not_of("0123456789") != string::npos)
+        return false;
+    const unsigned long n = std::stoul(text);
+    if(n > limit)
+        return false;
+    value = n;
+    return true;
 }
 
-int main()
+/* Print count puzzles of a variant with unique solutions, one per line,
+ * in the format the benchmark reads. */
+int generate_main(const string variant, unsigned count, unsigned seed)
 {
+    if(variant != "diagonal" && variant != "windoku" && variant != "killer")
+        return 2;
+    std::mt19937 rng(seed);
+    for(unsigned i = 0; i < count; i++)
+    {
+        if(variant == "diagonal")
+        {
+            Variant<Diagonal> v;
+            std::cout << v.random_puzzle(v.random_solution(rng), rng) << std::endl;
+        }
+        else if(variant == "windoku")
+        {
+            Variant<Windoku> v;
+            std::cout << v.random_puzzle(v.random_solution(rng), rng) << std::endl;
+        }
+        else if(variant == "killer")
+        {
+            const auto solution = Variant<Classic>().random_solution(rng);
+            const auto cages = random_cages(solution, rng);
+            Variant<Killer> v(cages);
+            std::cout << format_killer(v.random_puzzle(solution, rng), cages) << std::endl;
+        }
+    }
+    return 0;
+}
+
+void print_batch_stats(const BatchStats& stats, const string label)
+{
+    double avg_duration = stats.solve_seconds / (double)std::max(stats.puzzles, 1ul);
+    std::cout << "Solved " << stats.solved << " of " << stats.puzzles << " " << label
+              << " puzzles (" << stats.invalid << " invalid) in " << fixed << setprecision(3)
+              << stats.solve_seconds << " seconds [avg: " << setprecision(4) << avg_duration
+              << " sec, max: " << setprecision(3) << stats.max_seconds << " sec]" << std::endl;
+}
+
+bool parse_mode(const string name, SearchMode& mode)
+{
+    if(name == "norvig")
+        mode = SearchMode::NORVIG;
+    else if(name == "bitboard")
+        mode = SearchMode::BITBOARD;
+    else if(name == "learning")
+        mode = SearchMode::LEARNING;
+    else
+        return false;
+    return true;
+}
+
+int usage()
+{
+    std::cout << "usage: sudoku\n"
+              << "       sudoku batch <input> <prefix> <shards> [<index>|all] [norvig|bitboard|learning]\n"
+              << "       sudoku merge <prefix> <shards> <output>\n"
+              << "       sudoku generate <diagonal|windoku|killer> <count> [<seed>]" << std::endl;
+    return 2;
+}
+
+/* Run one shard, or every shard when index is "all". Shards are taken
+ * from a stack by one worker per hardware thread, so each solve is timed
+ * without the others competing for its core. Rerunning the same command
+ * resumes from the last checkpoints. */
+int batch_main(const string input, const string prefix, unsigned num_shards,
+               const string index, const SearchMode mode)
+{
+    std::vector<unsigned> shards;
+    if(index == "all")
+        for(unsigned k = 0; k < num_shards; k++)
+            shards.push_back(k);
+    else
+    {
+        unsigned k;
+        if(!parse_unsigned(index, num_shards - 1, k))
+            return usage();
+        shards.push_back(k);
+    }
+
+    ThreadSafeStack<unsigned> pending;
+    for(unsigned i = shards.size(); i-- > 0; )
+        pending.push(i);  // shard 0 on top
+
+    std::vector<BatchStats> stats(shards.size());
+    std::vector<string> errors(shards.size());
+    const auto num_threads = get_num_threads(shards.size(), 1);
+    std::vector<std::thread> workers;
+    for(unsigned t = 0; t < num_threads; t++)
+        workers.push_back(std::thread([&]() {
+            try
+            {
+                for(unsigned i;;)
+                {
+                    pending.pop(i);  // throws EmptyStack when all are taken
+                    try
+                    {
+                        stats[i] = run_shard(input, prefix, shards[i], num_shards, mode);
+                    }
+                    catch(const std::exception& e)
+                    {
+                        errors[i] = e.what();
+                    }
+                }
+            }
+            catch(const EmptyStack&)
+            {
+            }
+        }));
+    join_all(workers);
+
+    int status = 0;
+    for(unsigned i = 0; i < shards.size(); i++)
+    {
+        const string label = "shard " + std::to_string(shards[i]);
+        if(!errors[i].empty())
+        {
+            std::cout << label << ": " << errors[i] << std::endl;
+            status = 1;
+        }
+        else
+            print_batch_stats(stats[i], label);
+    }
+    return status;
+}
+
+int merge_main(const string prefix, unsigned num_shards, const string output)
+{
+    try
+    {
+        print_batch_stats(merge_shards(prefix, num_shards, output), output);
+    }
+    catch(const std::exception& e)
+    {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const vector<string> args(argv + 1, argv + argc);
+    if(!args.empty())
+    {
+        try
+        {
+            SearchMode mode = SearchMode::NORVIG;
+            unsigned num_shards = 0;
+            if(args[0] == "batch" && args.size() >= 4 && args.size() <= 6 &&
+               parse_unsigned(args[3], MAX_SHARDS, num_shards) && num_shards > 0 &&
+               (args.size() < 6 || parse_mode(args[5], mode)))
+                return batch_main(args[1], args[2], num_shards,
+                                  args.size() >= 5 ? args[4] : "all", mode);
+            if(args[0] == "merge" && args.size() == 4 &&
+               parse_unsigned(args[2], MAX_SHARDS, num_shards) && num_shards > 0)
+                return merge_main(args[1], num_shards, args[3]);
+            unsigned count = 0, seed = 1;
+            if(args[0] == "generate" && args.size() >= 3 && args.size() <= 4 &&
+               parse_unsigned(args[2], UINT_MAX, count) &&
+               (args.size() < 4 || parse_unsigned(args[3], UINT_MAX, seed)) &&
+               generate_main(args[1], count, seed) == 0)
+                return 0;
+        }
+        catch(const std::logic_error&)  // invalid_argument or out_of_range from stoul
+        {
+        }
+        return usage();
+    }
+
     std::cout << "Sudoku version 1.7\n";
     unit_test();
 
@@ -217,6 +485,17 @@ int main()
     solve_all(from_file("hardest.txt"), "hardest", false, 1.0);
     solve_all_mt(from_file("sudoku17.txt"), "sudoku17", false, 1.0);
     solve_all(random_puzzles(100), "random", false, 1.0);
+    solve_all(from_file("top95.txt"), "top95 (bitboard)", false, 1.0, SearchMode::BITBOARD);
+    solve_all(from_file("hardest.txt"), "hardest (bitboard)", false, 1.0, SearchMode::BITBOARD);
+    solve_all(hard1, "hard1 (bitboard)", false, 1.0, SearchMode::BITBOARD);
+    solve_all(impossible1, "impossible1 (bitboard)", false, 1.0, SearchMode::BITBOARD);
+    solve_all(from_file("top95.txt"), "top95 (learning)", false, 1.0, SearchMode::LEARNING);
+    solve_all(from_file("hardest.txt"), "hardest (learning)", false, 1.0, SearchMode::LEARNING);
+    solve_all(hard1, "hard1 (learning)", false, 1.0, SearchMode::LEARNING);
+    solve_all(impossible1, "impossible1 (learning)", false, 1.0, SearchMode::LEARNING);
+    solve_all_variant<Diagonal>(from_file("diagonal.txt"), "diagonal");
+    solve_all_variant<Windoku>(from_file("windoku.txt"), "windoku");
+    solve_all_variant<Killer>(lines_from_file("killer.txt"), "killer");
     solve_all(hard1, "hard1", false, 1.0);
     solve_all(impossible1, "impossible1", false, 1.0);
     return 0;
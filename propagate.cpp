@@ -0,0 +1,513 @@
+#include "propagate.hpp"
+#include <cassert>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define SUDOKU_VECTOR_KERNELS
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+namespace sudoku {
+
+    namespace {
+
+    constexpr uint16_t ALL = 0x1FF;  // digits 1 to 9
+
+    inline int box_of(int r, int c) { return (r / 3) * 3 + c / 3; }
+
+    /* Scalar kernel; also the reference the vector kernels are tested
+     * against, so it follows them step for step. */
+    void scan_scalar(const Board& board, UnitScan& scan)
+    {
+      memset(&scan, 0, sizeof scan);
+      for(int r = 0; r < 9; r++)
+        for(int c = 0; c < 9; c++)
+        {
+          const uint16_t v = board.cand[r][c];
+          const int units[3] = {c, 9 + r, 18 + box_of(r, c)};
+          for(const auto u: units)
+          {
+            scan.twice[u] |= scan.once[u] & v;
+            scan.once[u] |= v;
+          }
+        }
+    }
+
+    bool propagate_scalar(Board& board)
+    {
+      for(;;)
+      {
+        // (1) Remove every placed digit from the other squares of its units
+        Board singles = {};
+        for(int r = 0; r < 9; r++)
+          for(int c = 0; c < 9; c++)
+          {
+            const uint16_t v = board.cand[r][c];
+            if(!(v & (v - 1)))
+              singles.cand[r][c] = v;
+          }
+        UnitScan placed;
+        scan_scalar(singles, placed);
+        for(int u = 0; u < 27; u++)
+          if(placed.twice[u])
+            return false; // contradiction; digit placed twice in a unit
+
+        bool changed = false;
+        for(int r = 0; r < 9; r++)
+          for(int c = 0; c < 9; c++)
+          {
+            uint16_t& v = board.cand[r][c];
+            if(singles.cand[r][c])
+              continue;
+            const uint16_t n = v & ~(placed.once[c] | placed.once[9 + r] |
+                                     placed.once[18 + box_of(r, c)]);
+            if(n == 0)
+              return false; // contradiction; no digit left for the square
+            changed |= (n != v);
+            v = n;
+          }
+
+        // (2) Put every digit with one place left in a unit there
+        UnitScan scan;
+        scan_scalar(board, scan);
+        uint16_t hidden[27];
+        for(int u = 0; u < 27; u++)
+        {
+          if(scan.once[u] != ALL)
+            return false; // contradiction; no place for a digit
+          hidden[u] = scan.once[u] & ~scan.twice[u] & ~placed.once[u];
+        }
+        for(int r = 0; r < 9; r++)
+          for(int c = 0; c < 9; c++)
+          {
+            uint16_t& v = board.cand[r][c];
+            const uint16_t h = v & (hidden[c] | hidden[9 + r] | hidden[18 + box_of(r, c)]);
+            if(h == 0)
+              continue;
+            if(h & (h - 1))
+              return false; // contradiction; square needed by two digits
+            changed |= (h != v);
+            v = h;
+          }
+
+        if(!changed)
+          return true;
+      }
+    }
+
+#ifdef SUDOKU_VECTOR_KERNELS
+    /* The vector kernel is written once with GCC vector extensions and
+     * compiled twice: as is for SSE2, and inside a target("avx2") function
+     * for AVX2. A row of 16 lanes is one AVX2 register or two SSE2 ones.
+     * Everything below is always_inline so each copy gets the instruction
+     * set of the function it is inlined into. */
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+// No vector crosses a call boundary, so the AVX ABI warnings are moot
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+    typedef uint16_t Lanes __attribute__((vector_size(32)));
+    typedef int16_t LaneIndex __attribute__((vector_size(32)));
+
+    struct OnceTwice {
+      Lanes once;
+      Lanes twice;
+    };
+
+    // Helpers return a Vec, not bare Lanes: GCC reports -Wpsabi for a bare
+    // 32 byte vector return at the end of the file, past any pragma pop
+    struct Vec {
+      Lanes v;
+    };
+
+    KERNEL_INLINE Vec splat(uint16_t x)
+    {
+      return Vec{Lanes{} + x};
+    }
+
+    KERNEL_INLINE bool any(const Lanes& v)
+    {
+      uint64_t q[4];
+      memcpy(q, &v, sizeof q);
+      return (q[0] | q[1] | q[2] | q[3]) != 0;
+    }
+
+    // Instruction set tags; lane shifts and compares differ between the two
+    struct Sse2 {};
+    struct Avx2 {};
+
+    // Lane i takes lane i + N; the top N lanes are filled with 0
+    template<int N>
+    KERNEL_INLINE Vec down(Avx2, const Lanes& x)
+    {
+      const LaneIndex m = {N + 0, N + 1, N + 2, N + 3, N + 4, N + 5, N + 6, N + 7,
+                           N + 8, N + 9, N + 10, N + 11, N + 12, N + 13, N + 14, N + 15};
+      return Vec{__builtin_shuffle(x, Lanes{}, m)};
+    }
+
+    // GCC scalarizes 32 byte shuffles and compares without AVX2, so the
+    // SSE2 versions work on the two halves of a row
+    template<int N>
+    KERNEL_INLINE Vec down(Sse2, const Lanes& x)
+    {
+      __m128i h[2];
+      memcpy(h, &x, sizeof h);
+      if(N < 8)
+      {
+        h[0] = _mm_or_si128(_mm_srli_si128(h[0], 2 * N), _mm_slli_si128(h[1], 16 - 2 * N));
+        h[1] = _mm_srli_si128(h[1], 2 * N);
+      }
+      else
+      {
+        h[0] = h[1];
+        h[1] = _mm_setzero_si128();
+      }
+      Vec y;
+      memcpy(&y.v, h, sizeof h);
+      return y;
+    }
+
+    // All ones in the lanes of x that are zero
+    KERNEL_INLINE Vec is_zero(Avx2, const Lanes& x)
+    {
+      return Vec{(Lanes)(x == 0)};
+    }
+
+    KERNEL_INLINE Vec is_zero(Sse2, const Lanes& x)
+    {
+      __m128i h[2];
+      memcpy(h, &x, sizeof h);
+      h[0] = _mm_cmpeq_epi16(h[0], _mm_setzero_si128());
+      h[1] = _mm_cmpeq_epi16(h[1], _mm_setzero_si128());
+      Vec y;
+      memcpy(&y.v, h, sizeof h);
+      return y;
+    }
+
+    template<int N, class Isa>
+    KERNEL_INLINE OnceTwice down(Isa isa, const OnceTwice& x)
+    {
+      return OnceTwice{down<N>(isa, x.once).v, down<N>(isa, x.twice).v};
+    }
+
+    // Merge the digits of two disjoint sets of squares
+    KERNEL_INLINE void merge(OnceTwice& a, const OnceTwice& b)
+    {
+      a.twice |= b.twice | (a.once & b.once);
+      a.once |= b.once;
+    }
+
+    KERNEL_INLINE void merge(OnceTwice& a, const Lanes& v)
+    {
+      a.twice |= a.once & v;
+      a.once |= v;
+    }
+
+    /* Columns fall out of merging the rows lane by lane. Rows are folded
+     * into lane 0 in four shift-and-merge steps; boxes fold three rows lane
+     * by lane, then lanes 0-2, 3-5 and 6-8 in two steps. */
+    template<class Isa>
+    KERNEL_INLINE void scan_vector(Isa isa, const Lanes row[9], UnitScan& scan)
+    {
+      OnceTwice col = {};
+      for(int r = 0; r < 9; r++)
+        merge(col, row[r]);
+      for(int c = 0; c < 9; c++)
+      {
+        scan.once[c] = col.once[c];
+        scan.twice[c] = col.twice[c];
+      }
+
+      for(int r = 0; r < 9; r++)
+      {
+        OnceTwice x = {row[r], Lanes{}};
+        merge(x, down<1>(isa, x));
+        merge(x, down<2>(isa, x));
+        merge(x, down<4>(isa, x));
+        merge(x, down<8>(isa, x));
+        scan.once[9 + r] = x.once[0];
+        scan.twice[9 + r] = x.twice[0];
+      }
+
+      for(int br = 0; br < 3; br++)
+      {
+        OnceTwice x = {row[3 * br], Lanes{}};
+        merge(x, row[3 * br + 1]);
+        merge(x, row[3 * br + 2]);
+        OnceTwice y = x;
+        merge(y, down<1>(isa, x));
+        merge(y, down<2>(isa, x));
+        for(int bc = 0; bc < 3; bc++)
+        {
+          scan.once[18 + 3 * br + bc] = y.once[3 * bc];
+          scan.twice[18 + 3 * br + bc] = y.twice[3 * bc];
+        }
+      }
+    }
+
+    // Column masks in lanes 0-8, and for each band of boxes the box of each lane
+    struct UnitLanes {
+      Lanes col;
+      Lanes box[3];
+    };
+
+    KERNEL_INLINE UnitLanes unit_lanes(const uint16_t mask[27])
+    {
+      alignas(32) uint16_t lanes[4][16] = {};
+      for(int c = 0; c < 9; c++)
+      {
+        lanes[0][c] = mask[c];
+        for(int br = 0; br < 3; br++)
+          lanes[1 + br][c] = mask[18 + 3 * br + c / 3];
+      }
+      UnitLanes u;
+      memcpy(&u.col, lanes[0], sizeof u.col);
+      for(int br = 0; br < 3; br++)
+        memcpy(&u.box[br], lanes[1 + br], sizeof u.box[br]);
+      return u;
+    }
+
+    KERNEL_INLINE Vec unit_mask(const UnitLanes& u, const uint16_t mask[27], int r)
+    {
+      return Vec{u.col | splat(mask[9 + r]).v | u.box[r / 3]};
+    }
+
+    template<class Isa>
+    KERNEL_INLINE void scan_lanes(Isa isa, const Board& board, UnitScan& scan)
+    {
+      Lanes row[9];
+      memcpy(row, board.cand, sizeof row);
+      scan_vector(isa, row, scan);
+    }
+
+    // Same steps as propagate_scalar(), one row of squares at a time
+    template<class Isa>
+    KERNEL_INLINE bool propagate_lanes(Isa isa, Board& board)
+    {
+      Lanes valid = {};
+      for(int c = 0; c < 9; c++)
+        valid[c] = 0xFFFF;
+
+      Lanes row[9];
+      memcpy(row, board.cand, sizeof row);
+      bool ok = true;
+      for(;;)
+      {
+        // (1) Remove every placed digit from the other squares of its units
+        Lanes single[9], singles[9];
+        for(int r = 0; r < 9; r++)
+        {
+          const Lanes v = row[r];
+          single[r] = is_zero(isa, v & (v - 1)).v & ~is_zero(isa, v).v;
+          singles[r] = v & single[r];
+        }
+        UnitScan placed;
+        scan_vector(isa, singles, placed);
+        uint16_t twice = 0;
+        for(int u = 0; u < 27; u++)
+          twice |= placed.twice[u];
+        if(twice)
+        {
+          ok = false; // contradiction; digit placed twice in a unit
+          break;
+        }
+
+        const UnitLanes p = unit_lanes(placed.once);
+        Lanes changed = {}, empty = {};
+        for(int r = 0; r < 9; r++)
+        {
+          const Lanes v = row[r];
+          const Lanes n = v & (~unit_mask(p, placed.once, r).v | single[r]);
+          empty |= is_zero(isa, n).v & valid;
+          changed |= n ^ v;
+          row[r] = n;
+        }
+        if(any(empty))
+        {
+          ok = false; // contradiction; no digit left for a square
+          break;
+        }
+
+        // (2) Put every digit with one place left in a unit there
+        UnitScan scan;
+        scan_vector(isa, row, scan);
+        uint16_t hidden[27];
+        uint16_t missing = 0;
+        for(int u = 0; u < 27; u++)
+        {
+          missing |= scan.once[u] ^ ALL;
+          hidden[u] = scan.once[u] & ~scan.twice[u] & ~placed.once[u];
+        }
+        if(missing)
+        {
+          ok = false; // contradiction; no place for a digit
+          break;
+        }
+
+        const UnitLanes h = unit_lanes(hidden);
+        Lanes multi = {};
+        for(int r = 0; r < 9; r++)
+        {
+          const Lanes v = row[r];
+          const Lanes hit = v & unit_mask(h, hidden, r).v;
+          const Lanes take = ~is_zero(isa, hit).v;
+          multi |= ~is_zero(isa, hit & (hit - 1)).v;
+          const Lanes n = (hit & take) | (v & ~take);
+          changed |= n ^ v;
+          row[r] = n;
+        }
+        if(any(multi))
+        {
+          ok = false; // contradiction; square needed by two digits
+          break;
+        }
+
+        if(!any(changed))
+          break;
+      }
+      memcpy(board.cand, row, sizeof row);
+      return ok;
+    }
+
+    void scan_sse2(const Board& board, UnitScan& scan)
+    {
+      scan_lanes(Sse2(), board, scan);
+    }
+
+    bool propagate_sse2(Board& board)
+    {
+      return propagate_lanes(Sse2(), board);
+    }
+
+    __attribute__((target("avx2")))
+    void scan_avx2(const Board& board, UnitScan& scan)
+    {
+      scan_lanes(Avx2(), board, scan);
+    }
+
+    __attribute__((target("avx2")))
+    bool propagate_avx2(Board& board)
+    {
+      return propagate_lanes(Avx2(), board);
+    }
+#pragma GCC diagnostic pop
+#endif
+
+    Kernel detect_kernel()
+    {
+#ifdef SUDOKU_VECTOR_KERNELS
+      __builtin_cpu_init();
+      if(__builtin_cpu_supports("avx2"))
+        return Kernel::AVX2;
+      return Kernel::SSE2;
+#else
+      return Kernel::SCALAR;
+#endif
+    }
+
+    } // namespace
+
+    Kernel default_kernel()
+    {
+      static const Kernel kernel = detect_kernel();
+      return kernel;
+    }
+
+    const char* to_string(Kernel kernel)
+    {
+      switch(kernel)
+      {
+        case Kernel::SCALAR: return "scalar";
+        case Kernel::SSE2:   return "sse2";
+        case Kernel::AVX2:   return "avx2";
+      }
+      return "unknown";
+    }
+
+    Board make_board(const string& grid)
+    {
+      assert(grid.size() == 81);
+      Board board = {};
+      for(int i = 0; i < 81; i++)
+      {
+        const unsigned d = (unsigned char)grid[i] - '1';
+        board.cand[i / 9][i % 9] = d < 9 ? (uint16_t)(1u << d) : ALL;
+      }
+      return board;
+    }
+
+    string board_grid(const Board& board)
+    {
+      string grid(81, '.');
+      for(int i = 0; i < 81; i++)
+      {
+        const uint16_t v = board.cand[i / 9][i % 9];
+        if(v && !(v & (v - 1)))
+          grid[i] = '1' + __builtin_ctz(v);
+      }
+      return grid;
+    }
+
+    void scan_units(const Board& board, UnitScan& scan, Kernel kernel)
+    {
+      switch(kernel)
+      {
+#ifdef SUDOKU_VECTOR_KERNELS
+        case Kernel::AVX2: scan_avx2(board, scan); return;
+        case Kernel::SSE2: scan_sse2(board, scan); return;
+#endif
+        default: scan_scalar(board, scan); return;
+      }
+    }
+
+    bool propagate(Board& board, Kernel kernel)
+    {
+      switch(kernel)
+      {
+#ifdef SUDOKU_VECTOR_KERNELS
+        case Kernel::AVX2: return propagate_avx2(board);
+        case Kernel::SSE2: return propagate_sse2(board);
+#endif
+        default: return propagate_scalar(board);
+      }
+    }
+
+    bool search(Board& board, unsigned long& nodes, Kernel kernel)
+    {
+      nodes++;
+      if(!propagate(board, kernel))
+        return false;
+
+      // Find the square with the fewest possibilities
+      int min_r = -1, min_c = -1, min_size = 10;
+      for(int r = 0; r < 9; r++)
+        for(int c = 0; c < 9; c++)
+        {
+          int size = 0;
+          for(uint16_t v = board.cand[r][c]; v; v &= v - 1)
+            size++;
+          if(size > 1 && size < min_size)
+          {
+            min_size = size;
+            min_r = r;
+            min_c = c;
+          }
+        }
+      if(min_r < 0) // solved!
+        return true;
+
+      for(uint16_t v = board.cand[min_r][min_c]; v; v &= v - 1)
+      {
+        Board copy = board;
+        copy.cand[min_r][min_c] = v & -v;
+        if(search(copy, nodes, kernel))
+        {
+          board = copy;
+          return true;
+        }
+      }
+      return false;
+    }
+
+} // namespace sudoku
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace sudoku {
+
+/* Candidates for one board, one 16 bit lane per square: bit d-1 is set
+ * while digit d is still possible. Each row is padded to 16 lanes so it
+ * fills one AVX2 register (or two SSE2 registers); padding lanes are 0. */
+struct Board {
+    alignas(32) uint16_t cand[9][16];
+};
+
+/* Digit masks for the 27 units, numbered as in Sudoku::make_unit_list:
+ * columns 0-8, rows 9-17, boxes 18-26. */
+struct UnitScan {
+    uint16_t once[27];   // digits with at least one place in the unit
+    uint16_t twice[27];  // digits with at least two places in the unit
+};
+
+// Implementations of the unit scan, fastest last
+enum class Kernel { SCALAR, SSE2, AVX2 };
+
+// Best kernel this CPU supports; checked once at first call
+Kernel default_kernel();
+const char* to_string(Kernel kernel);
+
+// Every square open except the clues of grid; grid must pass check_puzzle()
+Board make_board(const std::string& grid);
+
+// One character per square; unsolved squares are '.'
+std::string board_grid(const Board& board);
+
+void scan_units(const Board& board, UnitScan& scan, Kernel kernel = default_kernel());
+
+/* Assign naked and hidden singles until nothing changes. Each sweep scans
+ * all 27 units at once, so every hidden single and every digit with no
+ * place left is found in one pass. Returns false on a contradiction. */
+bool propagate(Board& board, Kernel kernel = default_kernel());
+
+/* Depth first search over propagated boards, branching on the square with
+ * the fewest candidates. nodes counts the boards propagated. */
+bool search(Board& board, unsigned long& nodes, Kernel kernel = default_kernel());
+
+} // namespace sudoku
@@ -1,9 +1,135 @@
 #include "sudoku.hpp"
+#include "batch.hpp"
+#include "variants.hpp"
+#include <csignal>
+#include <cstdio>
 #include <iostream>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <unistd.h>
 
 using namespace std;
 namespace sudoku {
 
+    namespace {
+
+    template<class F>
+    bool throws(F f)
+    {
+      try
+      {
+        f();
+      }
+      catch(const std::exception&)
+      {
+        return true;
+      }
+      return false;
+    }
+
+    // Solution and status of each result line; the times differ between runs
+    vector<string> batch_results(const string& path)
+    {
+      vector<string> results;
+      ifstream file(path);
+      string solution, status, seconds;
+      while(file >> solution >> status >> seconds)
+        results.push_back(solution + " " + status);
+      return results;
+    }
+
+    /* Shards, checkpoints and merges on a small file in a temporary
+     * directory: a run killed part way and resumed over a torn write must
+     * merge to the same results as one uninterrupted shard. */
+    void batch_test(const string& grid)
+    {
+      char dir_template[] = "/tmp/sudoku-test-XXXXXX";
+      const char* dir = mkdtemp(dir_template);
+      assert(dir);
+      const string base = string(dir) + "/";
+      const string input = base + "in.txt";
+      {
+        ofstream file(input, ios::binary);
+        for(int i = 0; i < 300; i++)
+        {
+          string relabelled = grid;  // digits shifted by i keep it a puzzle
+          for(auto& c: relabelled)
+            if(c != '0')
+              c = '1' + (c - '1' + i) % 9;
+          file << (i % 50 == 7 ? "bad line" : relabelled) << (i < 299 ? "\n" : "");
+        }
+      }
+
+      // shards tile the input on line boundaries; the last line has no newline
+      string text;
+      {
+        ifstream file(input, ios::binary);
+        text.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+      }
+      assert(text.back() != '\n');
+      for(unsigned n = 1; n <= 8; n++)
+      {
+        const auto shards = split_shards(input, n);
+        assert(shards.size() == n && shards[0].begin == 0 && shards.back().end == text.size());
+        for(unsigned k = 0; k < n; k++)
+        {
+          assert(shards[k].begin <= shards[k].end);
+          assert(k == 0 || shards[k].begin == shards[k - 1].end);
+          assert(shards[k].begin == 0 || shards[k].begin == text.size() ||
+                 text[shards[k].begin - 1] == '\n');
+        }
+      }
+      assert(throws([&]() { split_shards(input, 0); }));
+
+      const string ref = base + "ref";
+      assert(run_shard(input, ref, 0, 1, SearchMode::BITBOARD).puzzles == 300);
+      merge_shards(ref, 1, ref + ".txt");
+      const auto expected = batch_results(ref + ".txt");
+      assert(expected.size() == 300 && expected[7] == string(81, '.') + " invalid");
+
+      // kill shard 0 part way, with a checkpoint after every puzzle
+      const string prefix = base + "s";
+      const pid_t child = fork();
+      assert(child >= 0);
+      if(child == 0)
+      {
+        run_shard(input, prefix, 0, 2, SearchMode::BITBOARD, 1);
+        _exit(0);
+      }
+      while(access(shard_path(prefix, 0, "ckpt").c_str(), F_OK) != 0)
+        usleep(100);
+      kill(child, SIGKILL);
+      waitpid(child, nullptr, 0);
+      assert(throws([&]() { merge_shards(prefix, 2, base + "out.txt"); }));  // unfinished
+
+      // a torn line past the checkpoint is dropped on resume
+      {
+        ofstream out(shard_path(prefix, 0, "out"), ios::binary | ios::app);
+        out << "torn";
+      }
+      assert(throws([&]() { run_shard(input, prefix, 1, 2, SearchMode::NORVIG); }));
+      assert(throws([&]() { run_shard(input, prefix, 1, 3, SearchMode::BITBOARD); }));
+      for(unsigned k = 0; k < 2; k++)
+        run_shard(input, prefix, k, 2, SearchMode::BITBOARD, 1);
+      assert(merge_shards(prefix, 2, base + "out.txt").puzzles == 300);
+      assert(batch_results(base + "out.txt") == expected);
+      assert(throws([&]() { merge_shards(prefix, 1, base + "out.txt"); }));  // shard count
+
+      // shard 1 of another run, solved in another mode, is not merged
+      const string other = base + "o";
+      run_shard(input, other, 1, 2, SearchMode::NORVIG);
+      for(const string ext: {"out", "ckpt"})
+        rename(shard_path(other, 1, ext).c_str(), shard_path(prefix, 1, ext).c_str());
+      assert(throws([&]() { merge_shards(prefix, 2, base + "out.txt"); }));
+
+      for(const string name: {"in.txt", "ref.0.out", "ref.0.ckpt", "ref.txt", "s.0.out",
+                              "s.0.ckpt", "s.1.out", "s.1.ckpt", "out.txt"})
+        remove((base + name).c_str());
+      rmdir(dir);
+    }
+
+    } // namespace
+
     map<string, string> Sudoku::init_values()
     {
       map<string, string> v;
@@ -140,6 +266,92 @@ namespace sudoku {
                 "A1", "A3", "B1", "B3" };
         assert(peers["C2"] == peers_c2);
 
+        const string grid1 =
+          "003020600900305001001806400008102900700000008006708200002609500800203009005010300";
+        const string soln1 =
+          "483921657967345821251876493548132976729564138136798245372689514814253769695417382";
+        assert(check_puzzle(grid1) == GridStatus::OK);
+        assert(check_puzzle(grid1.substr(1)) == GridStatus::BAD_LENGTH);
+        assert(check_puzzle("x" + grid1.substr(1)) == GridStatus::BAD_CHAR);
+        assert(check_puzzle("6" + grid1.substr(1)) == GridStatus::CONFLICT);
+        assert(check_solution(grid1, soln1) == GridStatus::OK);
+        assert(check_solution(grid1, grid1) == GridStatus::INCOMPLETE);
+        assert(check_solution("1" + grid1.substr(1), soln1) == GridStatus::MISMATCH);
+        assert(check_solution(grid1, soln1.substr(0, 80) + "1") == GridStatus::CONFLICT);
+
+        for(const auto kernel: {Kernel::SCALAR, Kernel::SSE2, Kernel::AVX2})
+        {
+          if(kernel > default_kernel())
+            continue; // not supported by this CPU
+          Board board = make_board(grid1);
+          assert(propagate(board, kernel));
+          assert(board_grid(board) == soln1);
+          board = make_board("6" + grid1.substr(1));
+          assert(!propagate(board, kernel));
+        }
+
+        string learnt_solution;
+        LearningSearch learning;
+        assert(learning.solve(grid1, learnt_solution) && learnt_solution == soln1);
+        assert(!learning.solve(
+          ".....5.8....6.1.43..........1.5........1.6...3.......553.....61........4.........",
+          learnt_solution));
+        assert(learning.stats().conflicts > 0 && learning.stats().nogoods_learned > 0);
+
+        // grid1's solution has a repeated digit on both diagonals
+        assert(Variant<Classic>().check(grid1, soln1));
+        assert(!Variant<Diagonal>().check(grid1, soln1));
+        const string diag1 =
+          "2....6...573........1.....47...2.......7...91.24.......5.9........3.....9.....1..";
+        Board board = make_board(diag1);
+        unsigned long nodes = 0;
+        assert(Variant<Diagonal>().search(board, nodes));
+        assert(Variant<Diagonal>().check(diag1, board_grid(board)));
+
+        const string killer1 =
+          "...............8................3................................................ "
+          "aabbccdefggbcccdhijkbllmnhijjbommpqrjssotmrrruvooowwrxyyzzABBCCyyzzzDBBCyEEFGGGCC "
+          "6,19,23,17,1,7,12,5,10,26,9,15,17,5,22,7,4,22,7,4,7,5,11,9,22,24,8,24,29,4,9,3,12";
+        string killer_grid;
+        vector<Cage> cages;
+        assert(parse_killer(killer1, killer_grid, cages) && cages.size() == 33);
+        assert(format_killer(killer_grid, cages) == killer1);
+        const Variant<Killer> killer(cages);
+        board = make_board(killer_grid);
+        assert(killer.search(board, nodes) && killer.check(killer_grid, board_grid(board)));
+        assert(killer.count_solutions(make_board(killer_grid), 2) == 1);
+
+        // lanes of one batch fail differently; each must match the scalar check
+        const string bad_soln = soln1.substr(0, 80) + "1";
+        const vector<string> puzzles = {
+          grid1, grid1, grid1, grid1, "1" + grid1.substr(1), grid1, grid1, grid1.substr(1),
+          grid1, grid1, "x" + grid1.substr(1)
+        };
+        const vector<string> solutions = {
+          soln1, "x" + soln1.substr(1), bad_soln, grid1, soln1, soln1.substr(1), soln1, soln1,
+          soln1.substr(0, 40) + "." + soln1.substr(41), bad_soln, soln1
+        };
+        const vector<GridStatus> expected = {
+          GridStatus::OK, GridStatus::BAD_CHAR, GridStatus::CONFLICT, GridStatus::INCOMPLETE,
+          GridStatus::MISMATCH, GridStatus::BAD_LENGTH, GridStatus::OK, GridStatus::BAD_LENGTH,
+          GridStatus::INCOMPLETE, GridStatus::CONFLICT, GridStatus::BAD_CHAR
+        };
+        const auto statuses = check_solutions(puzzles, solutions);
+        assert(statuses == expected);
+        for(unsigned i = 0; i < puzzles.size(); i++)
+          assert(statuses[i] == check_solution(puzzles[i], solutions[i]));
+        const auto puzzle_statuses = check_puzzles(solutions);
+        for(unsigned i = 0; i < solutions.size(); i++)
+          assert(puzzle_statuses[i] == check_puzzle(solutions[i]));
+        assert(puzzle_statuses[1] == GridStatus::BAD_CHAR && puzzle_statuses[2] == GridStatus::CONFLICT &&
+               puzzle_statuses[3] == GridStatus::OK && puzzle_statuses[5] == GridStatus::BAD_LENGTH);
+        assert(throws([&]() { check_solutions(puzzles, vector<string>(3, soln1)); }));
+
+        assert(solve(grid1) && solution() == soln1);
+        assert(!solve("6" + grid1.substr(1)) && solution() == string(SIZE * SIZE, '.'));
+
+        batch_test(grid1);
+
         std::cout << "All tests pass" << std::endl;
     }
 
@@ -215,16 +427,20 @@ namespace sudoku {
       // then put it there
       for(const auto& unit : units[s])
       {
-        vector<string> dplaces;
-	for(const auto s: unit)
-	  if(values[s].find(d) != string::npos)
-	    dplaces.push_back(s);
-	if(dplaces.size() == 0)
-	  return false; // contradiction; no place for this value
-        else if (dplaces.size() == 1)
+        unsigned num_places = 0;
+        const string* dplace = nullptr;
+        for(const auto& u: unit)
+          if(values[u].find(d) != string::npos)
+          {
+            num_places++;
+            dplace = &u;
+          }
+        if(num_places == 0)
+          return false; // contradiction; no place for this value
+        else if (num_places == 1)
           // d can only be one place in unit; assign it there
-          if(assign(values, dplaces[0], d) == false)
-	    return false;
+          if(assign(values, *dplace, d) == false)
+            return false;
       }
       return true;
     }
@@ -272,44 +488,57 @@ namespace sudoku {
 
     bool Sudoku::solve(const string& grid)
     {
+      if(check_puzzle(grid) != GridStatus::OK)
+      {
+        // malformed input or conflicting clues; forget the previous puzzle
+        for(const auto &s: squares)
+          values[s] = digits;
+        return false;
+      }
+      if(mode == SearchMode::BITBOARD)
+      {
+        Board board = make_board(grid);
+        const bool solved = sudoku::search(board, steps);
+        for(unsigned i = 0; i < squares.size(); i++)
+        {
+          values[squares[i]].clear();
+          for(unsigned d = 0; d < digits.size(); d++)
+            if(board.cand[i / SIZE][i % SIZE] & (1u << d))
+              values[squares[i]] += digits[d];
+        }
+        return solved;
+      }
+      if(mode == SearchMode::LEARNING)
+      {
+        string solution;
+        const auto start = learner.stats().propagations;
+        const bool solved = learner.solve(grid, solution);
+        steps += learner.stats().propagations - start;
+        for(unsigned i = 0; i < squares.size(); i++)
+          values[squares[i]] = solution[i] == '.' ? digits : string(1, solution[i]);
+        return solved;
+      }
       if(parse_grid(values, grid) == true)
         return search(values);
       else
 	return false;
     }
 
-    /* A unit is solved when its values are permutation of the
-     * digits 1 to 9. */
-    bool Sudoku::is_unit_solved(const vector<string>& unit)
+    /* The current values as an 81 character grid; squares with more
+     * than one possibility are shown as '.' */
+    string Sudoku::solution()
     {
-      static const char *str = digits.c_str();
-      static const unordered_set<char> dd(str,str+strlen(str));
-
-      unordered_set<char> uu;
-      for(const auto &s: unit)
-	for(const auto &d: values[s])
-          uu.emplace(d);
-
-      if(uu != dd)
-        return false;
-
-      return true;
+      string grid;
+      for(const auto &s: squares)
+        grid += values[s].size() == 1 ? values[s][0] : '.';
+      return grid;
     }
 
-    /* A puzzle is solved when all of its units are solved. */
+    /* A puzzle is solved when every square has one value and all 27
+     * units (9 rows, 9 cols, 9 squares) are permutations of 1 to 9. */
     bool Sudoku::is_solved()
     {
-      for(const auto s: squares)
-	if(values[s].size() != 1)
-	  return false;
-      
-      // check all 27 units are solved (9 rows, 9 cols, 9 squares)
-      for(const auto& unit: unit_list)
-      {
-	if(is_unit_solved(unit) == false)
-	  return false;
-      }
-      return true;
+      return check_solution(solution()) == GridStatus::OK;
     }
 
     void replace(string& str, const string& from, const string& to)
@@ -14,12 +14,21 @@
 #include <random>
 #include <unordered_set>
 #include <vector>
+#include "grid_check.hpp"
+#include "learning.hpp"
+#include "propagate.hpp"
 
 using namespace std;
 namespace sudoku {
 
 using ValuesMap = std::map<std::string, std::string>;
 
+/* How Sudoku::solve() searches. NORVIG is constraint propagation over
+ * ValuesMap as in Peter's article; BITBOARD propagates all 27 units of a
+ * Board at once with the SIMD kernels of propagate.hpp; LEARNING learns
+ * nogoods from conflicts and backjumps with learning.hpp. */
+enum class SearchMode { NORVIG, BITBOARD, LEARNING };
+
 class Sudoku {
 public:
     constexpr static int SIZE = 9;
@@ -30,9 +39,13 @@ public:
     void unit_test();
     unsigned long get_steps() { return steps; }
     void set_steps(unsigned long val) { steps = val; }
+    SearchMode get_mode() { return mode; }
+    void set_mode(SearchMode val) { mode = val; }
+    const LearningStats& get_learning_stats() { return learner.stats(); }
     void display();
     bool solve(const string& grid);
     bool is_solved();
+    string solution();
     string random_puzzle(unsigned n=17);
 
 private:
@@ -45,6 +58,8 @@ private:
     map<string, unordered_set<string>> peers = init_peers(units);
 
     unsigned long steps = 0;
+    SearchMode mode = SearchMode::NORVIG;
+    LearningSearch learner;
     ValuesMap values = init_values();
 
     vector<string> cross(const string& row, const string& col);
@@ -58,7 +73,6 @@ private:
     bool parse_grid(ValuesMap& values, const string& grid);
     bool assign(ValuesMap& values, const string& s, const string& d);
     bool eliminate(ValuesMap& values, const string& s, const string& d);
-    bool is_unit_solved(const vector<string>& unit);
     bool search(ValuesMap& values);
 };
 
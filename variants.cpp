@@ -0,0 +1,455 @@
+#include "variants.hpp"
+#include "grid_check.hpp"
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+
+using namespace std;
+namespace sudoku {
+
+    const int Classic::extra_units[1][9] = {};
+    const int Killer::extra_units[1][9] = {};
+
+    const int Diagonal::extra_units[2][9] = {
+      {0, 10, 20, 30, 40, 50, 60, 70, 80},
+      {8, 16, 24, 32, 40, 48, 56, 64, 72}
+    };
+
+    const int Windoku::extra_units[4][9] = {
+      {10, 11, 12, 19, 20, 21, 28, 29, 30},
+      {14, 15, 16, 23, 24, 25, 32, 33, 34},
+      {46, 47, 48, 55, 56, 57, 64, 65, 66},
+      {50, 51, 52, 59, 60, 61, 68, 69, 70}
+    };
+
+    namespace {
+
+    constexpr uint16_t ALL = 0x1FF;  // digits 1 to 9
+
+    inline uint16_t& square(Board& board, int s) { return board.cand[s / 9][s % 9]; }
+    inline uint16_t square(const Board& board, int s) { return board.cand[s / 9][s % 9]; }
+    inline bool is_single(uint16_t v) { return v && !(v & (v - 1)); }
+
+    inline int bit_count(uint16_t v)
+    {
+      int n = 0;
+      for(; v; v &= v - 1)
+        n++;
+      return n;
+    }
+
+    /* Digit sets a cage may use, by cage size and sum: every mask with that
+     * many digits adding up to that sum. */
+    struct CageCombos {
+      vector<uint16_t> combos[10][46];
+
+      CageCombos()
+      {
+        for(uint16_t m = 1; m <= ALL; m++)
+        {
+          int sum = 0;
+          for(int d = 0; d < 9; d++)
+            if(m & (1 << d))
+              sum += d + 1;
+          combos[bit_count(m)][sum].push_back(m);
+        }
+      }
+    };
+
+    const CageCombos& cage_combos()
+    {
+      static const CageCombos c;
+      return c;
+    }
+
+    const string CAGE_LABELS =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!#$%&()*+-/:<=>?@[]^_{|}~";
+
+    // Square with the fewest candidates, or -1 when all are placed
+    int min_square(const Board& board)
+    {
+      int min_s = -1, min_size = 10;
+      for(int s = 0; s < 81; s++)
+      {
+        const int size = bit_count(square(board, s));
+        if(size > 1 && size < min_size)
+        {
+          min_size = size;
+          min_s = s;
+        }
+      }
+      return min_s;
+    }
+
+    } // namespace
+
+    /* Same rules as propagate() applies to the 27 classic units: placed
+     * digits leave the other squares, a digit with one place goes there. */
+    template<class Rules>
+    bool Variant<Rules>::propagate_units(Board& board, bool& changed) const
+    {
+      for(int u = 0; u < Rules::NUM_EXTRA_UNITS; u++)
+      {
+        const int* unit = Rules::extra_units[u];
+        uint16_t once = 0, twice = 0, placed = 0;
+        for(int k = 0; k < 9; k++)
+        {
+          const uint16_t v = square(board, unit[k]);
+          twice |= once & v;
+          once |= v;
+          if(is_single(v))
+          {
+            if(placed & v)
+              return false; // contradiction; digit placed twice in a unit
+            placed |= v;
+          }
+        }
+        if(once != ALL)
+          return false; // contradiction; no place for a digit
+
+        const uint16_t hidden = once & ~twice & ~placed;
+        for(int k = 0; k < 9; k++)
+        {
+          uint16_t& v = square(board, unit[k]);
+          if(is_single(v))
+            continue;
+          uint16_t n = v & ~placed;
+          const uint16_t h = n & hidden;
+          if(h & (h - 1))
+            return false; // contradiction; square needed by two digits
+          if(h)
+            n = h;
+          if(n == 0)
+            return false; // contradiction; no digit left for the square
+          changed |= (n != v);
+          v = n;
+        }
+      }
+      return true;
+    }
+
+    /* A digit set is possible for a cage when it keeps the placed digits and
+     * its digits can cover the cage: every square has one of them, and
+     * together the squares offer all of them. Squares keep only digits of
+     * some possible set, and the cage's placed digits leave the rest of it. */
+    template<class Rules>
+    bool Variant<Rules>::propagate_cages(Board& board, bool& changed) const
+    {
+      const CageCombos& table = cage_combos();
+      for(const auto& cage: cages)
+      {
+        const auto& combos = table.combos[cage.squares.size()][cage.sum];
+        uint16_t placed = 0;
+        for(const auto s: cage.squares)
+        {
+          const uint16_t v = square(board, s);
+          if(is_single(v))
+          {
+            if(placed & v)
+              return false; // contradiction; digit repeated in a cage
+            placed |= v;
+          }
+        }
+
+        uint16_t allowed = 0;
+        for(const auto combo: combos)
+        {
+          if(placed & ~combo)
+            continue;
+          uint16_t offered = 0;
+          bool covered = true;
+          for(const auto s: cage.squares)
+          {
+            const uint16_t v = square(board, s) & combo;
+            covered &= (v != 0);
+            offered |= v;
+          }
+          if(covered && offered == combo)
+            allowed |= combo;
+        }
+        if(allowed == 0)
+          return false; // contradiction; no digits fit the cage sum
+
+        for(const auto s: cage.squares)
+        {
+          uint16_t& v = square(board, s);
+          uint16_t n = v & allowed;
+          if(!is_single(v))
+            n &= ~placed;
+          if(n == 0)
+            return false;
+          changed |= (n != v);
+          v = n;
+        }
+      }
+      return true;
+    }
+
+    template<class Rules>
+    bool Variant<Rules>::propagate(Board& board, Kernel kernel) const
+    {
+      for(;;)
+      {
+        if(!sudoku::propagate(board, kernel))
+          return false;
+        if(Rules::NUM_EXTRA_UNITS == 0 && !Rules::CAGES)
+          return true;
+
+        bool changed = false;
+        if(Rules::NUM_EXTRA_UNITS > 0 && !propagate_units(board, changed))
+          return false;
+        if(Rules::CAGES && !propagate_cages(board, changed))
+          return false;
+        if(!changed)
+          return true;
+      }
+    }
+
+    template<class Rules>
+    bool Variant<Rules>::search(Board& board, unsigned long& nodes, Kernel kernel) const
+    {
+      if(Rules::NUM_EXTRA_UNITS == 0 && !Rules::CAGES)
+        return sudoku::search(board, nodes, kernel);
+
+      nodes++;
+      if(!propagate(board, kernel))
+        return false;
+      const int s = min_square(board);
+      if(s < 0) // solved!
+        return true;
+
+      for(uint16_t v = square(board, s); v; v &= v - 1)
+      {
+        Board copy = board;
+        square(copy, s) = v & -v;
+        if(search(copy, nodes, kernel))
+        {
+          board = copy;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    template<class Rules>
+    unsigned Variant<Rules>::count_solutions(const Board& start, unsigned limit) const
+    {
+      Board board = start;
+      if(!propagate(board))
+        return 0;
+      const int s = min_square(board);
+      if(s < 0)
+        return 1;
+
+      unsigned count = 0;
+      for(uint16_t v = square(board, s); v && count < limit; v &= v - 1)
+      {
+        Board copy = board;
+        square(copy, s) = v & -v;
+        count += count_solutions(copy, limit - count);
+      }
+      return count;
+    }
+
+    template<class Rules>
+    bool Variant<Rules>::check(const string& puzzle, const string& solution) const
+    {
+      if(check_solution(puzzle, solution) != GridStatus::OK)
+        return false;
+      for(int u = 0; u < Rules::NUM_EXTRA_UNITS; u++)
+      {
+        uint16_t seen = 0;
+        for(const auto s: Rules::extra_units[u])
+          seen |= 1 << (solution[s] - '1');
+        if(seen != ALL)
+          return false;
+      }
+      for(const auto& cage: cages)
+      {
+        uint16_t seen = 0;
+        int sum = 0;
+        for(const auto s: cage.squares)
+        {
+          seen |= 1 << (solution[s] - '1');
+          sum += solution[s] - '0';
+        }
+        if(bit_count(seen) != (int)cage.squares.size() || sum != cage.sum)
+          return false;
+      }
+      return true;
+    }
+
+    // Depth first search like search(), trying digits in random order
+    template<class Rules>
+    bool Variant<Rules>::random_fill(Board& board, mt19937& rng) const
+    {
+      if(!propagate(board))
+        return false;
+      const int s = min_square(board);
+      if(s < 0)
+        return true;
+
+      vector<uint16_t> choices;
+      for(uint16_t v = square(board, s); v; v &= v - 1)
+        choices.push_back(v & -v);
+      shuffle(choices.begin(), choices.end(), rng);
+      for(const auto d: choices)
+      {
+        Board copy = board;
+        square(copy, s) = d;
+        if(random_fill(copy, rng))
+        {
+          board = copy;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    template<class Rules>
+    string Variant<Rules>::random_solution(mt19937& rng) const
+    {
+      Board board = make_board(string(81, '.'));
+      const bool filled = random_fill(board, rng);
+      assert(filled);
+      (void)filled;
+      return board_grid(board);
+    }
+
+    template<class Rules>
+    string Variant<Rules>::random_puzzle(const string& solution, mt19937& rng) const
+    {
+      string grid = solution;
+      vector<int> order(81);
+      for(int s = 0; s < 81; s++)
+        order[s] = s;
+      shuffle(order.begin(), order.end(), rng);
+      for(const auto s: order)
+      {
+        const char clue = grid[s];
+        grid[s] = '.';
+        if(count_solutions(make_board(grid), 2) != 1)
+          grid[s] = clue; // needed for a unique solution
+      }
+      return grid;
+    }
+
+    template class Variant<Classic>;
+    template class Variant<Diagonal>;
+    template class Variant<Windoku>;
+    template class Variant<Killer>;
+
+    bool parse_killer(const string& line, string& grid, vector<Cage>& cages)
+    {
+      istringstream fields(line);
+      string map, sums;
+      if(!(fields >> grid >> map >> sums) || grid.size() != 81 || map.size() != 81)
+        return false;
+
+      string labels;
+      vector<vector<int>> squares;
+      for(int s = 0; s < 81; s++)
+      {
+        if(map[s] == '.')
+          continue; // not in a cage
+        const auto k = labels.find(map[s]);
+        if(k == string::npos)
+        {
+          labels += map[s];
+          squares.push_back({s});
+        }
+        else
+          squares[k].push_back(s);
+      }
+
+      cages.clear();
+      istringstream list(sums);
+      string sum;
+      for(size_t k = 0; getline(list, sum, ','); k++)
+      {
+        if(k >= squares.size() || squares[k].size() > 9)
+          return false;
+        const int n = atoi(sum.c_str());
+        if(n < 1 || n > 45)
+          return false;
+        cages.push_back(Cage{squares[k], n});
+      }
+      return cages.size() == squares.size();
+    }
+
+    string format_killer(const string& grid, const vector<Cage>& cages)
+    {
+      assert(cages.size() <= CAGE_LABELS.size());
+      // list cages in order of their first square, as parse_killer() reads them
+      vector<pair<int, size_t>> order;
+      for(size_t k = 0; k < cages.size(); k++)
+        order.push_back({*min_element(cages[k].squares.begin(), cages[k].squares.end()), k});
+      sort(order.begin(), order.end());
+
+      string map(81, '.');
+      string sums;
+      for(size_t n = 0; n < order.size(); n++)
+      {
+        const Cage& cage = cages[order[n].second];
+        for(const auto s: cage.squares)
+          map[s] = CAGE_LABELS[n];
+        sums += (n ? "," : "") + std::to_string(cage.sum);
+      }
+      return grid + " " + map + " " + sums;
+    }
+
+    /* Grow each cage from a random open square through random open
+     * neighbours, never taking a digit the cage already has. */
+    vector<Cage> random_cages(const string& solution, mt19937& rng, unsigned max_size)
+    {
+      vector<int> cage_of(81, -1);
+      vector<Cage> cages;
+      vector<int> order(81);
+      for(int s = 0; s < 81; s++)
+        order[s] = s;
+      shuffle(order.begin(), order.end(), rng);
+
+      for(const auto start: order)
+      {
+        if(cage_of[start] >= 0)
+          continue;
+        const unsigned size = 1 + rng() % max_size;
+        Cage cage = {{start}, 0};
+        uint16_t digits = 1 << (solution[start] - '1');
+        cage_of[start] = (int)cages.size();
+        while(cage.squares.size() < size)
+        {
+          vector<int> next;
+          for(const auto s: cage.squares)
+          {
+            const int r = s / 9, c = s % 9;
+            const int around[4][2] = {{r - 1, c}, {r + 1, c}, {r, c - 1}, {r, c + 1}};
+            for(const auto& rc: around)
+            {
+              if(rc[0] < 0 || rc[0] > 8 || rc[1] < 0 || rc[1] > 8)
+                continue;
+              const int t = rc[0] * 9 + rc[1];
+              if(cage_of[t] < 0 && !(digits & (1 << (solution[t] - '1'))))
+                next.push_back(t);
+            }
+          }
+          if(next.empty())
+            break;
+          const int t = next[rng() % next.size()];
+          cage_of[t] = cage_of[start];
+          digits |= 1 << (solution[t] - '1');
+          cage.squares.push_back(t);
+        }
+        cages.push_back(cage);
+      }
+
+      for(auto& cage: cages)
+      {
+        sort(cage.squares.begin(), cage.squares.end());
+        for(const auto s: cage.squares)
+          cage.sum += solution[s] - '0';
+      }
+      return cages;
+    }
+
+} // namespace sudoku
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "propagate.hpp"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace sudoku {
+
+/* Constraint sets, chosen at compile time as the Rules of a Variant.
+ * EXTRA_UNITS are all-different units beyond the 27 rows, columns and
+ * boxes; CAGES adds killer cages. Classic has neither, so Variant<Classic>
+ * is exactly the bitboard search of propagate.hpp. */
+struct Classic {
+    static constexpr int NUM_EXTRA_UNITS = 0;
+    static constexpr bool CAGES = false;
+    static const int extra_units[1][9];  // unused
+};
+
+// X-sudoku: both main diagonals are units
+struct Diagonal {
+    static constexpr int NUM_EXTRA_UNITS = 2;
+    static constexpr bool CAGES = false;
+    static const int extra_units[2][9];
+};
+
+// Windoku: four extra 3x3 windows, at rows 2-4 and 6-8 by columns 2-4 and 6-8
+struct Windoku {
+    static constexpr int NUM_EXTRA_UNITS = 4;
+    static constexpr bool CAGES = false;
+    static const int extra_units[4][9];
+};
+
+// Killer: cages of distinct digits adding up to a given sum
+struct Killer {
+    static constexpr int NUM_EXTRA_UNITS = 0;
+    static constexpr bool CAGES = true;
+    static const int extra_units[1][9];  // unused
+};
+
+struct Cage {
+    std::vector<int> squares;  // 0 to 80, row by row
+    int sum;
+};
+
+template<class Rules>
+class Variant {
+public:
+    Variant() = default;
+    explicit Variant(const std::vector<Cage>& cages) : cages(cages) { }
+
+    const std::vector<Cage>& get_cages() const { return cages; }
+
+    // Classic propagation, then the extra units and cages, to a fixed point
+    bool propagate(Board& board, Kernel kernel = default_kernel()) const;
+    bool search(Board& board, unsigned long& nodes, Kernel kernel = default_kernel()) const;
+    // Number of solutions of board, counting no further than limit
+    unsigned count_solutions(const Board& board, unsigned limit) const;
+    // solution passes check_solution() and satisfies the extra units and cages
+    bool check(const std::string& puzzle, const std::string& solution) const;
+
+    // A random puzzle with a unique solution; clues are removed while it stays unique
+    std::string random_puzzle(const std::string& solution, std::mt19937& rng) const;
+    std::string random_solution(std::mt19937& rng) const;
+
+private:
+    std::vector<Cage> cages;
+
+    bool propagate_units(Board& board, bool& changed) const;
+    bool propagate_cages(Board& board, bool& changed) const;
+    bool random_fill(Board& board, std::mt19937& rng) const;
+};
+
+/* Killer puzzles are written on one line as three fields:
+ *
+ *     <81 character grid> <81 character cage map> <sum>,<sum>,...
+ *
+ * Squares with the same character in the cage map share a cage, and '.'
+ * marks a square in no cage. Sums are listed in order of each cage's
+ * first square. */
+bool parse_killer(const std::string& line, std::string& grid, std::vector<Cage>& cages);
+std::string format_killer(const std::string& grid, const std::vector<Cage>& cages);
+
+// Cover the grid with random connected cages of 1 to max_size squares
+std::vector<Cage> random_cages(const std::string& solution, std::mt19937& rng,
+                               unsigned max_size = 5);
+
+} // namespace sudoku